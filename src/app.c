@@ -4,6 +4,20 @@
 #include <GLFW/glfw3.h>
 #include "renderer.h"
 #include "physics.h"
+#include "constraints.h"
+#include "softbody.h"
+#include "rigidbody.h"
+#include "colliders.h"
+#include "sdf.h"
+#include "sph.h"
+#include "pairs.h"
+#include "nbody.h"
+#include "pm.h"
+#include "tools.h"
+#include "events.h"
+#include "ensemble.h"
+#include "domain.h"
+#include "tiles.h"
 #include <time.h>
 #include <string.h>
 
@@ -11,18 +25,69 @@
 #define PARTICLE_SPAWN_Y (WINDOW_HEIGHT * 0.99f)
 
 #define TARGET_FPS 60.0
+#define PHYSICS_DT (1.0f / 60.0f) // Fixed simulation step, split into substeps
+#define MAX_STEPS_PER_FRAME 4 // Caps catch-up work so slow frames can't spiral
 #define SPAWN_DELAY 0.01
 
-#define SUBSTEPS 8
+#define SUBSTEPS 8 // Used when ADAPTIVE_SUBSTEPS is off
 
-#define CONTAINER 0 // box = 0, circle = 1
+#define ADAPTIVE_SUBSTEPS 1
+#define MIN_SUBSTEPS 4 // Fewer collision iterations let deep piles compress
+#define MAX_SUBSTEPS 16
+#define SUBSTEP_CFL 0.5f // Max fraction of a radius a particle may move per substep
 
-int elapsedFrames = 0;
+#define BLOCK_TIMESTEPS 0 // Step quiet regions every 2, 4, ... substeps
+
+#define CONTAINER 0 // box = 0, circle = 1, signed distance field = 2, periodic box = 3
+#define PERIODIC_X 1 // Axes the periodic box wraps
+#define PERIODIC_Y 0
+
+#define STATIC_RAMP 1 // Adds the rampShape polyline as static colliders
+
+#define TILED_WORLD 0 // Page idle tiles out to TILE_DIRECTORY; paged tiles are not drawn
+#define TILE_DIRECTORY "."
+#define TILE_IDLE_SECONDS 5.0f
+
+#define FLUID_MODE 0 // Spawned particles behave as SPH fluid instead of grains
+
+#define MUTUAL_GRAVITY 0 // uniform gravity = 0, Barnes-Hut tree = 1, particle mesh = 2
+#define MESH_BOUNDARY PM_ISOLATED // Boundary of the particle-mesh solver
+
+// Mouse tools, selected with the number keys and applied with the left button
+#define TOOL_DRAG 0
+#define TOOL_EXPLODE 1
+#define TOOL_SPAWN 2
+#define TOOL_ERASE 3
+#define NUM_TOOLS 4
+static const char* toolNames[NUM_TOOLS] = {"Drag", "Explode", "Spawn", "Erase"};
 
-extern Particle particles[NUM_PARTICLES];
+int elapsedFrames = 0;
 
-void instantiateParticles(Particle* particle_list, int numParticles) {
-    for (int i = 0; i < numParticles; i++) {
+// Hopper outline used when CONTAINER is the signed distance field
+static const mfloat_t sdfContainerShape[] = {
+    WINDOW_WIDTH / 2 - 60, 40,
+    WINDOW_WIDTH / 2 + 60, 40,
+    WINDOW_WIDTH / 2 + 60, 200,
+    WINDOW_WIDTH / 2 + 420, 520,
+    WINDOW_WIDTH / 2 + 420, 850,
+    WINDOW_WIDTH / 2 - 420, 850,
+    WINDOW_WIDTH / 2 - 420, 520,
+    WINDOW_WIDTH / 2 - 60, 200
+};
+#define SDF_CONTAINER_VERTICES ((int)(sizeof(sdfContainerShape) / sizeof(sdfContainerShape[0]) / 2))
+
+// Kinked ramp under the spawn stream, used when STATIC_RAMP is set
+static const mfloat_t rampShape[] = {
+    WINDOW_WIDTH / 4 - 20, 640,
+    WINDOW_WIDTH / 4 + 220, 540,
+    WINDOW_WIDTH / 4 + 340, 520
+};
+#define RAMP_VERTICES ((int)(sizeof(rampShape) / sizeof(rampShape[0]) / 2))
+
+// Places particles [first, first + numParticles) in the spawn stream. Slots
+// are re-instantiated on activation since erased particles leave stale data.
+void instantiateParticles(Particle* particle_list, int first, int numParticles) {
+    for (int i = first; i < first + numParticles; i++) {
         Particle* p = &(particle_list[i]);
         // ===== STREAM =====
         int distance = 7.0f;
@@ -34,6 +99,7 @@ void instantiateParticles(Particle* particle_list, int numParticles) {
         vec2(p->old_position, xp, yp);
         vec2(p->acceleration, 0, 0);
         p->radius = PARTICLE_RADIUS;
+        p->temperature = AMBIENT_TEMPERATURE;
     }
 }
 
@@ -44,9 +110,37 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     update_projection(width, height);
 }
 
-int main(void) {
+// Runs the sweep described in configPath without opening a window
+static int runEnsembleMode(const char* configPath, const char* outputPath, bool lockstep) {
+    EnsembleRun* runs = (EnsembleRun*)malloc(MAX_ENSEMBLE_RUNS * sizeof(EnsembleRun));
+    if (!runs) {
+        fprintf(stderr, "Failed to allocate memory for ensemble runs\n");
+        return -1;
+    }
+    int numRuns = loadEnsembleRuns(configPath, runs, MAX_ENSEMBLE_RUNS);
+    int result = numRuns < 0 ? -1 : runEnsemble(runs, numRuns, outputPath, lockstep);
+    free(runs);
+    return result;
+}
+
+int main(int argc, char** argv) {
     GLFWwindow* window;
 
+    // app --ensemble <config> <output> runs a headless parameter sweep;
+    // --ensemble-lockstep packs small worlds into SIMD lanes
+    if (argc == 4 && strcmp(argv[1], "--ensemble") == 0) {
+        return runEnsembleMode(argv[2], argv[3], false);
+    }
+    if (argc == 4 && strcmp(argv[1], "--ensemble-lockstep") == 0) {
+        return runEnsembleMode(argv[2], argv[3], true);
+    }
+    // app --domain <ranks> <particles> <radius> <substeps> <frames> <output>
+    // splits one headless world into slabs stepped by separate processes
+    if (argc == 8 && strcmp(argv[1], "--domain") == 0) {
+        DomainRun run = {atoi(argv[2]), atoi(argv[3]), (mfloat_t)atof(argv[4]), atoi(argv[5]), atoi(argv[6])};
+        return runDomainSimulation(&run, argv[7]);
+    }
+
     if (!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
         return -1;
@@ -85,13 +179,37 @@ int main(void) {
 
     init_renderer(WINDOW_WIDTH, WINDOW_HEIGHT);
 
-    mfloat_t containerPos[VEC2_SIZE] = {WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2};
-
-    instantiateParticles(particles, NUM_PARTICLES);
-    int activeParticles = 0;
+    PhysicsWorld* world = createPhysicsWorld();
+    if (!world) {
+        glfwTerminate();
+        return -1;
+    }
+    world->container = CONTAINER;
+    if (CONTAINER == 3) setPeriodicBoundaries(world, PERIODIC_X, PERIODIC_Y);
+    if (TILED_WORLD) enableTiledWorld(world, TILE_DIRECTORY, TILE_IDLE_SECONDS);
+    world->gravity_mode = MUTUAL_GRAVITY;
+    world->mesh_boundary = MESH_BOUNDARY;
+    world->block_timesteps = BLOCK_TIMESTEPS;
+    world->substep_cfl = SUBSTEP_CFL;
+    Particle* particles = world->particles;
+
+    instantiateParticles(particles, 0, NUM_PARTICLES);
+
+    // Heated floor and cooled lid, visible with the temperature color mode
+    world->wall_temperature[WALL_BOTTOM] = TEMPERATURE_COLOR_MAX;
+    world->wall_heat_transfer[WALL_BOTTOM] = 0.1f;
+    world->wall_temperature[WALL_TOP] = TEMPERATURE_COLOR_MIN;
+    world->wall_heat_transfer[WALL_TOP] = 0.1f;
+    if (FLUID_MODE) {
+        initSph(world);
+        setParticleFluid(world, 0, NUM_PARTICLES, true);
+    }
     float spawnTimer = 0.0;
+    float accumulator = 0.0f;
 
     float dt = 0.000001f;
+    int substeps = SUBSTEPS;
+    float prevSubDt = 0.0f;
     float lastFrameTime = (float)glfwGetTime();
     char title[100] = "";
     srand(time(NULL));
@@ -103,8 +221,54 @@ int main(void) {
         return -1;
     }
 
-    bool colorByVelocity = true;
+    // Positions at the start of the last physics step, for render interpolation
+    float* previousPositions = (float*)malloc(NUM_PARTICLES * 2 * sizeof(float));
+    if (!previousPositions) {
+        fprintf(stderr, "Failed to allocate memory for previous positions\n");
+        glfwTerminate();
+        return -1;
+    }
+
+    if (CONTAINER == 2) {
+        clearSdf(world);
+        addSdfPolygon(world, sdfContainerShape, SDF_CONTAINER_VERTICES, false);
+    }
+    if (STATIC_RAMP && addStaticPolygon(world, rampShape, RAMP_VERTICES, false) > 0) {
+        buildStaticColliderIndex(world->colliders);
+    }
+
+    // Static geometry is indexed once and uploaded as line vertices. The SDF
+    // container outline is appended so it is drawn the same way.
+    const StaticColliders* colliders = world->colliders;
+    int num_static_segments = colliders ? colliders->num_static_segments : 0;
+    if (colliders) buildStaticColliderIndex(world->colliders);
+    int numOutlineSegments = (CONTAINER == 2) ? SDF_CONTAINER_VERTICES : 0;
+    float* segmentData = (float*)malloc((num_static_segments + numOutlineSegments + 1) * 4 * sizeof(float));
+    if (!segmentData) {
+        fprintf(stderr, "Failed to allocate memory for segment data\n");
+        glfwTerminate();
+        return -1;
+    }
+    for (int i = 0; i < num_static_segments; i++) {
+        segmentData[4 * i] = colliders->segment_ax[i];
+        segmentData[4 * i + 1] = colliders->segment_ay[i];
+        segmentData[4 * i + 2] = colliders->segment_bx[i];
+        segmentData[4 * i + 3] = colliders->segment_by[i];
+    }
+    for (int i = 0; i < numOutlineSegments; i++) {
+        int j = (i + 1) % numOutlineSegments;
+        float* segment = &segmentData[4 * (num_static_segments + i)];
+        segment[0] = sdfContainerShape[2 * i];
+        segment[1] = sdfContainerShape[2 * i + 1];
+        segment[2] = sdfContainerShape[2 * j];
+        segment[3] = sdfContainerShape[2 * j + 1];
+    }
+
+    int colorMode = COLOR_MODE_VELOCITY;
     bool vKeyPressed = false; // To prevent toggling multiple times per key press
+    bool tKeyPressed = false;
+    int tool = TOOL_DRAG;
+    bool mousePressed = false;
 
     while (!glfwWindowShouldClose(window)) {
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -113,51 +277,156 @@ int main(void) {
         // Handle input to toggle color mode
         if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
             if (!vKeyPressed) {
-                colorByVelocity = !colorByVelocity;
+                colorMode = (colorMode == COLOR_MODE_VELOCITY) ? COLOR_MODE_SOLID : COLOR_MODE_VELOCITY;
                 vKeyPressed = true;
             }
         } else {
             vKeyPressed = false;
         }
+        if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+            if (!tKeyPressed) {
+                colorMode = (colorMode == COLOR_MODE_TEMPERATURE) ? COLOR_MODE_VELOCITY : COLOR_MODE_TEMPERATURE;
+                tKeyPressed = true;
+            }
+        } else {
+            tKeyPressed = false;
+        }
 
-        spawnTimer += dt;
-        if (1.0 / dt >= TARGET_FPS - 0.1 && spawnTimer >= SPAWN_DELAY && activeParticles < NUM_PARTICLES) {
-            activeParticles += 1;
-            spawnTimer = 0.0;
+        // Mouse tools act on the world under the cursor. The projection maps
+        // framebuffer pixels to world units with y pointing up.
+        for (int key = 0; key < NUM_TOOLS; key++) {
+            if (glfwGetKey(window, GLFW_KEY_1 + key) == GLFW_PRESS && tool != key) {
+                endDrag(world);
+                tool = key;
+            }
+        }
+        double cursorX, cursorY;
+        int windowWidth, windowHeight, framebufferWidth, framebufferHeight;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        mfloat_t cursor[VEC2_SIZE] = {
+            (mfloat_t)(cursorX * framebufferWidth / windowWidth),
+            (mfloat_t)((windowHeight - cursorY) * framebufferHeight / windowHeight)
+        };
+        bool mouseDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        int particlesBeforeTool = world->active_particles;
+        if (tool == TOOL_DRAG) {
+            if (mouseDown && !mousePressed) {
+                beginDrag(world, cursor, TOOL_RADIUS);
+            } else if (mouseDown) {
+                moveDrag(world, cursor);
+            } else if (mousePressed) {
+                endDrag(world);
+            }
+        } else if (tool == TOOL_EXPLODE && mouseDown && !mousePressed) {
+            applyExplosion(world, cursor, TOOL_RADIUS, EXPLODE_SPEED, PHYSICS_DT / substeps);
+        } else if (tool == TOOL_SPAWN && mouseDown) {
+            brushSpawn(world, cursor, TOOL_RADIUS);
+        } else if (tool == TOOL_ERASE && mouseDown) {
+            brushErase(world, cursor, TOOL_RADIUS);
+        }
+        mousePressed = mouseDown;
+        int activeParticles = world->active_particles;
+        if (FLUID_MODE && activeParticles > particlesBeforeTool) {
+            // Spawned slots start out granular
+            setParticleFluid(world, particlesBeforeTool, activeParticles - particlesBeforeTool, true);
+        }
+        if (activeParticles != particlesBeforeTool) {
+            // Spawned and moved particles have no previous state to blend from
+            for (int i = 0; i < activeParticles; i++) {
+                previousPositions[2 * i] = particles[i].curr_position[0];
+                previousPositions[2 * i + 1] = particles[i].curr_position[1];
+            }
         }
 
-        sprintf(title, "FPS : %-4.0f | Particles : %-10d", 1.0 / dt, activeParticles);
-        glfwSetWindowTitle(window, title);
+        // Physics advances in fixed steps; the frame time only decides how
+        // many steps are due
+        accumulator += dt;
+        int steps = 0;
+        // Collision events collect over all of this frame's steps
+        clearCollisionEvents(world);
+        while (accumulator >= PHYSICS_DT && steps < MAX_STEPS_PER_FRAME) {
+            // Spawning is paced in simulated time, so the stream rate does
+            // not depend on the frame rate
+            spawnTimer += PHYSICS_DT;
+            if (spawnTimer >= SPAWN_DELAY && activeParticles < NUM_PARTICLES) {
+                initParticleSlot(world, activeParticles);
+                instantiateParticles(particles, activeParticles, 1);
+                if (FLUID_MODE) setParticleFluid(world, activeParticles, 1, true);
+                world->active_particles = ++activeParticles;
+                spawnTimer = 0.0;
+            }
+
+            if (ADAPTIVE_SUBSTEPS && prevSubDt > 0.0f) {
+                substeps = computeAdaptiveSubsteps(world, PHYSICS_DT, prevSubDt, MIN_SUBSTEPS, MAX_SUBSTEPS, SUBSTEP_CFL);
+            }
+            if (BLOCK_TIMESTEPS) {
+                // Every level must finish its block by the end of the step
+                substeps = (substeps + TIME_BLOCK_SUBSTEPS - 1) / TIME_BLOCK_SUBSTEPS * TIME_BLOCK_SUBSTEPS;
+            }
+            float subDt = PHYSICS_DT / substeps;
+            if (prevSubDt > 0.0f && subDt != prevSubDt) {
+                // Keep velocities consistent when the substep length changes
+                rescaleVelocities(world, subDt / prevSubDt);
+            }
+            prevSubDt = subDt;
 
-        // Update physics with multiple substeps for stability
-        float sub_dt = dt / SUBSTEPS;
-        for (int i = 0; i < SUBSTEPS; i++) {
-            applyGravity(activeParticles);
-            applyContainerConstraints(activeParticles, containerPos, CONTAINER);
-            detectCollisions(activeParticles);
-            updateParticlePositions(activeParticles, sub_dt);
+            for (int i = 0; i < activeParticles; i++) {
+                previousPositions[2 * i] = particles[i].curr_position[0];
+                previousPositions[2 * i + 1] = particles[i].curr_position[1];
+            }
+
+            stepPhysicsWorld(world, PHYSICS_DT, substeps);
+            if (TILED_WORLD && updateTiles(world, PHYSICS_DT) != activeParticles) {
+                // Paging moved particles between slots
+                activeParticles = world->active_particles;
+                for (int i = 0; i < activeParticles; i++) {
+                    previousPositions[2 * i] = particles[i].curr_position[0];
+                    previousPositions[2 * i + 1] = particles[i].curr_position[1];
+                }
+            }
+            accumulator -= PHYSICS_DT;
+            steps++;
         }
+        if (steps == MAX_STEPS_PER_FRAME) {
+            // Fell too far behind: drop the whole steps of the backlog
+            // instead of spiralling, keeping the fraction for interpolation
+            accumulator = fmodf(accumulator, PHYSICS_DT);
+        }
+        float alpha = accumulator / PHYSICS_DT;
+
+        sprintf(title, "FPS : %-4.0f | Particles : %-10d | Substeps : %-2d | Tool : %s",
+                1.0 / dt, activeParticles, substeps, toolNames[tool]);
+        glfwSetWindowTitle(window, title);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
         // Prepare instance data (positions and velocities)
         for (int i = 0; i < activeParticles; i++) {
-            // Positions
-            instanceData[4 * i] = particles[i].curr_position[0];
-            instanceData[4 * i + 1] = particles[i].curr_position[1];
+            // Positions, interpolated between the last two physics states. A
+            // particle that wrapped round the periodic box is drawn where it
+            // is instead of sliding back across the box.
+            float dx = particles[i].curr_position[0] - previousPositions[2 * i];
+            float dy = particles[i].curr_position[1] - previousPositions[2 * i + 1];
+            bool wrapped = MFABS(dx) > 0.5f * CONTAINER_PERIOD || MFABS(dy) > 0.5f * CONTAINER_PERIOD;
+            float blend = wrapped ? 1.0f : alpha;
+            instanceData[4 * i] = previousPositions[2 * i] + dx * blend;
+            instanceData[4 * i + 1] = previousPositions[2 * i + 1] + dy * blend;
 
             // Velocities
-            float vx = (particles[i].curr_position[0] - particles[i].old_position[0]) / dt;
-            float vy = (particles[i].curr_position[1] - particles[i].old_position[1]) / dt;
+            float vx = (particles[i].curr_position[0] - particles[i].old_position[0]) / PHYSICS_DT;
+            float vy = (particles[i].curr_position[1] - particles[i].old_position[1]) / PHYSICS_DT;
             instanceData[4 * i + 2] = vx;
             instanceData[4 * i + 3] = vy;
         }
 
         // Draw container first
-        draw_container(containerPos, CONTAINER);
+        draw_container(world->container_pos, world->container);
+        draw_segments(segmentData, num_static_segments + numOutlineSegments);
 
         // Then draw particles
-        draw_particles(activeParticles, instanceData, colorByVelocity);
+        draw_particles(activeParticles, instanceData, particles, colorMode);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -170,6 +439,9 @@ int main(void) {
     }
 
     free(instanceData);
+    free(previousPositions);
+    free(segmentData);
+    destroyPhysicsWorld(world);
     cleanup_renderer();
 
     glfwTerminate();
@@ -0,0 +1,219 @@
+#include "batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+WorldBatch* createWorldBatch(void) {
+    WorldBatch* batch = (WorldBatch*)calloc(1, sizeof(WorldBatch));
+    if (!batch) {
+        fprintf(stderr, "Failed to allocate memory for world batch\n");
+        return NULL;
+    }
+    batch->container_pos[0] = WINDOW_WIDTH / 2;
+    batch->container_pos[1] = WINDOW_HEIGHT / 2;
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        batch->gravity[lane] = GRAVITY;
+        batch->collision_response[lane] = COLLISION_RESPONSE;
+        batch->container_response[lane] = CONTAINER_RESPONSE;
+        batch->radius[lane] = PARTICLE_RADIUS;
+    }
+    return batch;
+}
+
+void destroyWorldBatch(WorldBatch* batch) {
+    free(batch);
+}
+
+int setBatchLane(WorldBatch* batch, int lane, int numParticles, mfloat_t gravity,
+                 mfloat_t collisionResponse, mfloat_t containerResponse, mfloat_t radius) {
+    if (lane < 0 || lane >= BATCH_LANES || numParticles < 0 || numParticles > BATCH_MAX_PARTICLES) {
+        printf("Error: batch lane %d cannot hold %d particles (max %d)\n", lane, numParticles, BATCH_MAX_PARTICLES);
+        return -1;
+    }
+    batch->active_particles[lane] = numParticles;
+    batch->gravity[lane] = gravity;
+    batch->collision_response[lane] = collisionResponse;
+    batch->container_response[lane] = containerResponse;
+    batch->radius[lane] = radius;
+    for (int i = 0; i < BATCH_MAX_PARTICLES; i++) {
+        ParticleLanes* slot = &batch->particles[i];
+        slot->curr_x[lane] = slot->curr_y[lane] = 0.0f;
+        slot->old_x[lane] = slot->old_y[lane] = 0.0f;
+        slot->id[lane] = i;
+    }
+    return 0;
+}
+
+void setBatchParticle(WorldBatch* batch, int lane, int index, const mfloat_t* position) {
+    // Slots may have been reordered by an earlier step
+    for (int i = 0; i < batch->active_particles[lane]; i++) {
+        ParticleLanes* slot = &batch->particles[i];
+        if (slot->id[lane] != index) continue;
+        slot->curr_x[lane] = slot->old_x[lane] = position[0];
+        slot->curr_y[lane] = slot->old_y[lane] = position[1];
+        return;
+    }
+}
+
+static int maxActiveParticles(const WorldBatch* batch) {
+    int count = 0;
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        if (batch->active_particles[lane] > count) count = batch->active_particles[lane];
+    }
+    return count;
+}
+
+// Insertion sort of each lane's slots by x. Particles move little per
+// substep, so this is close to a linear pass.
+static void sortLanes(WorldBatch* batch) {
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        for (int i = 1; i < batch->active_particles[lane]; i++) {
+            ParticleLanes* slots = batch->particles;
+            mfloat_t cx = slots[i].curr_x[lane];
+            mfloat_t cy = slots[i].curr_y[lane];
+            mfloat_t ox = slots[i].old_x[lane];
+            mfloat_t oy = slots[i].old_y[lane];
+            int id = slots[i].id[lane];
+            int j = i - 1;
+            for (; j >= 0 && slots[j].curr_x[lane] > cx; j--) {
+                slots[j + 1].curr_x[lane] = slots[j].curr_x[lane];
+                slots[j + 1].curr_y[lane] = slots[j].curr_y[lane];
+                slots[j + 1].old_x[lane] = slots[j].old_x[lane];
+                slots[j + 1].old_y[lane] = slots[j].old_y[lane];
+                slots[j + 1].id[lane] = slots[j].id[lane];
+            }
+            slots[j + 1].curr_x[lane] = cx;
+            slots[j + 1].curr_y[lane] = cy;
+            slots[j + 1].old_x[lane] = ox;
+            slots[j + 1].old_y[lane] = oy;
+            slots[j + 1].id[lane] = id;
+        }
+    }
+}
+
+// Same wall response as the box container of a PhysicsWorld
+static void applyBatchContainer(WorldBatch* batch, int count) {
+    const mfloat_t min_x = batch->container_pos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    const mfloat_t max_x = batch->container_pos[0] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH;
+    const mfloat_t min_y = batch->container_pos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    const mfloat_t max_y = batch->container_pos[1] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH;
+
+    mfloat_t radius[BATCH_LANES];
+    mfloat_t response[BATCH_LANES];
+    int active[BATCH_LANES];
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        radius[lane] = batch->radius[lane];
+        response[lane] = batch->container_response[lane];
+        active[lane] = batch->active_particles[lane];
+    }
+
+    for (int i = 0; i < count; i++) {
+        ParticleLanes* slot = &batch->particles[i];
+        #pragma omp simd
+        for (int lane = 0; lane < BATCH_LANES; lane++) {
+            mfloat_t r = radius[lane];
+            mfloat_t x = slot->curr_x[lane];
+            mfloat_t y = slot->curr_y[lane];
+            // Compares rather than fminf/fmaxf, which do not vectorize here
+            mfloat_t cx = x < min_x + r ? min_x + r : (x > max_x - r ? max_x - r : x);
+            mfloat_t cy = y < min_y + r ? min_y + r : (y > max_y - r ? max_y - r : y);
+            // Lanes past their particle count keep their slots untouched
+            mfloat_t live = (mfloat_t)(i < active[lane]);
+            mfloat_t hit_x = (mfloat_t)(cx != x) * live;
+            mfloat_t hit_y = (mfloat_t)(cy != y) * live;
+            slot->old_x[lane] += (cx + (x - slot->old_x[lane]) * response[lane] - slot->old_x[lane]) * hit_x;
+            slot->old_y[lane] += (cy + (y - slot->old_y[lane]) * response[lane] - slot->old_y[lane]) * hit_y;
+            slot->curr_x[lane] = x + (cx - x) * live;
+            slot->curr_y[lane] = y + (cy - y) * live;
+        }
+    }
+}
+
+// Sweep and prune along x in lockstep. Each lane's slots are sorted by x,
+// so a lane's sweep from slot i ends at the first slot further than a
+// contact distance away; the pair loop stops once every lane has ended.
+// Lanes that already ended, or have no particle in slot j, are masked.
+static void collideBatch(WorldBatch* batch, int count) {
+    mfloat_t reach[BATCH_LANES];
+    mfloat_t half_response[BATCH_LANES];
+    int active[BATCH_LANES];
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        reach[lane] = 2.0f * batch->radius[lane];
+        half_response[lane] = 0.5f * batch->collision_response[lane];
+        active[lane] = batch->active_particles[lane];
+    }
+
+    for (int i = 0; i < count - 1; i++) {
+        ParticleLanes* a = &batch->particles[i];
+        mfloat_t sweeping[BATCH_LANES];
+        for (int lane = 0; lane < BATCH_LANES; lane++) {
+            sweeping[lane] = (mfloat_t)(i < active[lane]);
+        }
+
+        for (int j = i + 1; j < count; j++) {
+            ParticleLanes* b = &batch->particles[j];
+            int any = 0;
+            #pragma omp simd reduction(| : any)
+            for (int lane = 0; lane < BATCH_LANES; lane++) {
+                mfloat_t dx = b->curr_x[lane] - a->curr_x[lane];
+                mfloat_t dy = b->curr_y[lane] - a->curr_y[lane];
+                sweeping[lane] *= (mfloat_t)(dx < reach[lane] && j < active[lane]);
+                any |= sweeping[lane] != 0.0f;
+
+                mfloat_t dist = MSQRT(dx * dx + dy * dy);
+                mfloat_t overlap = MFMAX(reach[lane] - dist, 0.0f) * sweeping[lane];
+                mfloat_t scale = half_response[lane] * overlap / (dist + MFLT_EPSILON);
+                a->curr_x[lane] -= dx * scale;
+                a->curr_y[lane] -= dy * scale;
+                b->curr_x[lane] += dx * scale;
+                b->curr_y[lane] += dy * scale;
+            }
+            if (!any) break;
+        }
+    }
+}
+
+static void integrateBatch(WorldBatch* batch, int count, float dt) {
+    const mfloat_t dt_sq = dt * dt;
+    mfloat_t fall[BATCH_LANES];
+    int active[BATCH_LANES];
+    for (int lane = 0; lane < BATCH_LANES; lane++) {
+        fall[lane] = batch->gravity[lane] * dt_sq;
+        active[lane] = batch->active_particles[lane];
+    }
+
+    for (int i = 0; i < count; i++) {
+        ParticleLanes* slot = &batch->particles[i];
+        #pragma omp simd
+        for (int lane = 0; lane < BATCH_LANES; lane++) {
+            mfloat_t live = (mfloat_t)(i < active[lane]);
+            mfloat_t vx = slot->curr_x[lane] - slot->old_x[lane];
+            mfloat_t vy = slot->curr_y[lane] - slot->old_y[lane];
+            slot->old_x[lane] += (slot->curr_x[lane] - slot->old_x[lane]) * live;
+            slot->old_y[lane] += (slot->curr_y[lane] - slot->old_y[lane]) * live;
+            slot->curr_x[lane] += vx * live;
+            slot->curr_y[lane] += (vy + fall[lane]) * live;
+        }
+    }
+}
+
+void stepWorldBatch(WorldBatch* batch, float dt, int substeps) {
+    const int count = maxActiveParticles(batch);
+    const float sub_dt = dt / substeps;
+    for (int s = 0; s < substeps; s++) {
+        applyBatchContainer(batch, count);
+        sortLanes(batch);
+        collideBatch(batch, count);
+        integrateBatch(batch, count, sub_dt);
+    }
+}
+
+void readBatchLane(const WorldBatch* batch, int lane, float subDt, float* state) {
+    for (int i = 0; i < batch->active_particles[lane]; i++) {
+        const ParticleLanes* slot = &batch->particles[i];
+        float* s = &state[4 * slot->id[lane]];
+        s[0] = slot->curr_x[lane];
+        s[1] = slot->curr_y[lane];
+        s[2] = (slot->curr_x[lane] - slot->old_x[lane]) / subDt;
+        s[3] = (slot->curr_y[lane] - slot->old_y[lane]) / subDt;
+    }
+}
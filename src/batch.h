@@ -0,0 +1,52 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define BATCH_LANES 8 // Worlds per batch; 16 suits AVX-512 with float positions
+#define BATCH_MAX_PARTICLES 1024
+
+// Particle slot i of every world in the batch, one world per lane, so a
+// loop over lanes is a single vector operation (AoSoA layout)
+typedef struct {
+    mfloat_t curr_x[BATCH_LANES];
+    mfloat_t curr_y[BATCH_LANES];
+    mfloat_t old_x[BATCH_LANES];
+    mfloat_t old_y[BATCH_LANES];
+    int id[BATCH_LANES]; // Particle index the slot holds; slots are kept sorted by x
+} ParticleLanes;
+
+// BATCH_LANES small worlds stepped in lockstep. Each world is a reduced
+// PhysicsWorld: uniform gravity, the box container and particle contacts
+// with a single radius. Lanes can have different settings and particle
+// counts; lanes with fewer particles are masked off.
+typedef struct {
+    ParticleLanes particles[BATCH_MAX_PARTICLES];
+    int active_particles[BATCH_LANES];
+    mfloat_t gravity[BATCH_LANES];
+    mfloat_t collision_response[BATCH_LANES];
+    mfloat_t container_response[BATCH_LANES];
+    mfloat_t radius[BATCH_LANES];
+    mfloat_t container_pos[VEC2_SIZE];
+} WorldBatch;
+
+// Creates a batch with every lane empty and the box container centred in
+// the window. Returns NULL if memory runs out.
+WorldBatch* createWorldBatch(void);
+void destroyWorldBatch(WorldBatch* batch);
+
+// Configures one lane. Particles start at the origin and at rest; place
+// them with setBatchParticle. Returns -1 if the settings are out of range.
+int setBatchLane(WorldBatch* batch, int lane, int numParticles, mfloat_t gravity,
+                 mfloat_t collisionResponse, mfloat_t containerResponse, mfloat_t radius);
+void setBatchParticle(WorldBatch* batch, int lane, int index, const mfloat_t* position);
+
+// Advances every lane by dt split into substeps
+void stepWorldBatch(WorldBatch* batch, float dt, int substeps);
+
+// Writes (x, y, vx, vy) of each of the lane's particles to state in
+// particle index order. subDt is the substep length of the last step.
+void readBatchLane(const WorldBatch* batch, int lane, float subDt, float* state);
+
+#endif
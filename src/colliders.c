@@ -0,0 +1,171 @@
+#include "colliders.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocates the world's static collider set on first use
+static StaticColliders* worldColliders(PhysicsWorld* world) {
+    if (!world->colliders) {
+        world->colliders = (StaticColliders*)calloc(1, sizeof(StaticColliders));
+        if (!world->colliders) {
+            fprintf(stderr, "Failed to allocate memory for static colliders\n");
+        }
+    }
+    return world->colliders;
+}
+
+int addStaticSegment(PhysicsWorld* world, mfloat_t* a, mfloat_t* b) {
+    StaticColliders* colliders = worldColliders(world);
+    if (!colliders) return -1;
+    if (colliders->num_static_segments >= MAX_STATIC_SEGMENTS) {
+        printf("Error: too many static segments (max %d)\n", MAX_STATIC_SEGMENTS);
+        return -1;
+    }
+    int s = colliders->num_static_segments++;
+    colliders->segment_ax[s] = a[0];
+    colliders->segment_ay[s] = a[1];
+    colliders->segment_bx[s] = b[0];
+    colliders->segment_by[s] = b[1];
+    colliders->index_built = 0;
+    return s;
+}
+
+int addStaticPolygon(PhysicsWorld* world, const mfloat_t* vertices, int numVertices, bool closed) {
+    int added = 0;
+    int edges = closed ? numVertices : numVertices - 1;
+    for (int i = 0; i < edges; i++) {
+        mfloat_t a[VEC2_SIZE] = {vertices[2 * i], vertices[2 * i + 1]};
+        int j = (i + 1) % numVertices;
+        mfloat_t b[VEC2_SIZE] = {vertices[2 * j], vertices[2 * j + 1]};
+        if (addStaticSegment(world, a, b) < 0) break;
+        added++;
+    }
+    return added;
+}
+
+void clearStaticColliders(PhysicsWorld* world) {
+    StaticColliders* colliders = world->colliders;
+    if (!colliders) return;
+    colliders->num_static_segments = 0;
+    free(colliders->cell_segments);
+    colliders->cell_segments = NULL;
+    colliders->index_built = 0;
+}
+
+static int clampCell(int c, int size) {
+    if (c < 0) return 0;
+    if (c >= size) return size - 1;
+    return c;
+}
+
+// Cell range covered by a segment's bounding box grown by the particle radius
+static void segmentCellRange(const StaticColliders* colliders, int s, int* x0, int* y0, int* x1, int* y1) {
+    const mfloat_t* segment_ax = colliders->segment_ax;
+    const mfloat_t* segment_ay = colliders->segment_ay;
+    const mfloat_t* segment_bx = colliders->segment_bx;
+    const mfloat_t* segment_by = colliders->segment_by;
+    mfloat_t margin = PARTICLE_RADIUS;
+    *x0 = clampCell((int)MFLOOR((MFMIN(segment_ax[s], segment_bx[s]) - margin) / COLLIDER_CELL_SIZE), COLLIDER_GRID_WIDTH);
+    *x1 = clampCell((int)MFLOOR((MFMAX(segment_ax[s], segment_bx[s]) + margin) / COLLIDER_CELL_SIZE), COLLIDER_GRID_WIDTH);
+    *y0 = clampCell((int)MFLOOR((MFMIN(segment_ay[s], segment_by[s]) - margin) / COLLIDER_CELL_SIZE), COLLIDER_GRID_HEIGHT);
+    *y1 = clampCell((int)MFLOOR((MFMAX(segment_ay[s], segment_by[s]) + margin) / COLLIDER_CELL_SIZE), COLLIDER_GRID_HEIGHT);
+}
+
+void buildStaticColliderIndex(StaticColliders* colliders) {
+    int* cell_start = colliders->cell_start;
+    const int num_segments = colliders->num_static_segments;
+    const int num_cells = COLLIDER_GRID_WIDTH * COLLIDER_GRID_HEIGHT;
+    for (int i = 0; i <= num_cells; i++) {
+        cell_start[i] = 0;
+    }
+
+    // Count segments per cell
+    for (int s = 0; s < num_segments; s++) {
+        int x0, y0, x1, y1;
+        segmentCellRange(colliders, s, &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                cell_start[y * COLLIDER_GRID_WIDTH + x + 1]++;
+            }
+        }
+    }
+    for (int i = 0; i < num_cells; i++) {
+        cell_start[i + 1] += cell_start[i];
+    }
+
+    free(colliders->cell_segments);
+    int* cell_segments = (int*)malloc((cell_start[num_cells] + 1) * sizeof(int));
+    colliders->cell_segments = cell_segments;
+    if (!cell_segments) {
+        fprintf(stderr, "Failed to allocate memory for the static collider index\n");
+        colliders->index_built = 0;
+        return;
+    }
+
+    // Fill, using cell_start[i] as a cursor then shifting it back
+    for (int s = 0; s < num_segments; s++) {
+        int x0, y0, x1, y1;
+        segmentCellRange(colliders, s, &x0, &y0, &x1, &y1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                cell_segments[cell_start[y * COLLIDER_GRID_WIDTH + x]++] = s;
+            }
+        }
+    }
+    for (int i = num_cells; i > 0; i--) {
+        cell_start[i] = cell_start[i - 1];
+    }
+    cell_start[0] = 0;
+
+    colliders->index_built = 1;
+}
+
+void applyStaticColliders(PhysicsWorld* world) {
+    StaticColliders* colliders = world->colliders;
+    if (!colliders || colliders->num_static_segments == 0) return;
+    if (!colliders->index_built) buildStaticColliderIndex(colliders);
+    if (!colliders->index_built) return;
+
+    const int* cell_start = colliders->cell_start;
+    const int* cell_segments = colliders->cell_segments;
+    const mfloat_t* segment_ax = colliders->segment_ax;
+    const mfloat_t* segment_ay = colliders->segment_ay;
+    const mfloat_t* segment_bx = colliders->segment_bx;
+    const mfloat_t* segment_by = colliders->segment_by;
+    const int activeParticles = world->active_particles;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < activeParticles; i++) {
+        Particle* p = &world->particles[i];
+        mfloat_t px = p->curr_position[0];
+        mfloat_t py = p->curr_position[1];
+        int cx = clampCell((int)MFLOOR(px / COLLIDER_CELL_SIZE), COLLIDER_GRID_WIDTH);
+        int cy = clampCell((int)MFLOOR(py / COLLIDER_CELL_SIZE), COLLIDER_GRID_HEIGHT);
+        int cell = cy * COLLIDER_GRID_WIDTH + cx;
+
+        // Push out of the deepest nearby segment only. Summing would count
+        // a polyline vertex once per edge meeting there and push twice as
+        // far at joints. The loop body selects instead of branching so the
+        // compiler can vectorize it over candidates.
+        mfloat_t push_x = 0.0f;
+        mfloat_t push_y = 0.0f;
+        mfloat_t deepest = 0.0f;
+        for (int k = cell_start[cell]; k < cell_start[cell + 1]; k++) {
+            int s = cell_segments[k];
+            mfloat_t ex = segment_bx[s] - segment_ax[s];
+            mfloat_t ey = segment_by[s] - segment_ay[s];
+            mfloat_t t = ((px - segment_ax[s]) * ex + (py - segment_ay[s]) * ey) / (ex * ex + ey * ey + MFLT_EPSILON);
+            t = MFMIN(MFMAX(t, 0.0f), 1.0f);
+            mfloat_t dx = px - (segment_ax[s] + t * ex);
+            mfloat_t dy = py - (segment_ay[s] + t * ey);
+            mfloat_t dist = MSQRT(dx * dx + dy * dy);
+            mfloat_t depth = MFMAX(p->radius - dist, 0.0f);
+            mfloat_t scale = depth / (dist + MFLT_EPSILON);
+            int deeper = depth > deepest;
+            push_x = deeper ? dx * scale : push_x;
+            push_y = deeper ? dy * scale : push_y;
+            deepest = MFMAX(deepest, depth);
+        }
+        p->curr_position[0] += push_x;
+        p->curr_position[1] += push_y;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef COLLIDERS_H
+#define COLLIDERS_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_STATIC_SEGMENTS 16384
+#define COLLIDER_CELL_SIZE 32 // Four particle grid cells
+#define COLLIDER_GRID_WIDTH (WINDOW_WIDTH / COLLIDER_CELL_SIZE + 1)
+#define COLLIDER_GRID_HEIGHT (WINDOW_HEIGHT / COLLIDER_CELL_SIZE + 1)
+
+typedef struct StaticColliders {
+    // Static segments in SoA form. Polygons are stored as their edges.
+    mfloat_t segment_ax[MAX_STATIC_SEGMENTS];
+    mfloat_t segment_ay[MAX_STATIC_SEGMENTS];
+    mfloat_t segment_bx[MAX_STATIC_SEGMENTS];
+    mfloat_t segment_by[MAX_STATIC_SEGMENTS];
+    int num_static_segments;
+
+    // Compressed cell lists: the segments overlapping cell (x, y) are
+    // cell_segments[cell_start[i]] .. cell_segments[cell_start[i + 1] - 1]
+    // with i = y * COLLIDER_GRID_WIDTH + x
+    int cell_start[COLLIDER_GRID_WIDTH * COLLIDER_GRID_HEIGHT + 1];
+    int* cell_segments;
+    int index_built;
+} StaticColliders;
+
+// Returns the segment index, or -1 if the segment could not be added
+int addStaticSegment(PhysicsWorld* world, mfloat_t* a, mfloat_t* b);
+
+// Adds the edges of a polyline given as (x, y) pairs. closed also connects
+// the last vertex back to the first. Returns the number of edges added.
+int addStaticPolygon(PhysicsWorld* world, const mfloat_t* vertices, int numVertices, bool closed);
+
+void clearStaticColliders(PhysicsWorld* world);
+
+// Buckets the segments into a uniform grid. Must be called after the last
+// segment is added and before applyStaticColliders.
+void buildStaticColliderIndex(StaticColliders* colliders);
+
+// Pushes every active particle out of the deepest segment stored in its
+// cell. Particles wedged in a corner leave it over successive substeps.
+void applyStaticColliders(PhysicsWorld* world);
+
+#endif
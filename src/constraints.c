@@ -0,0 +1,156 @@
+#include "constraints.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OVERFLOW_COLOR MAX_LINK_COLORS
+#define PARALLEL_BATCH_THRESHOLD 1024
+
+// Allocates the world's link set on first use
+static LinkSet* worldLinks(PhysicsWorld* world) {
+    if (!world->links) {
+        world->links = (LinkSet*)calloc(1, sizeof(LinkSet));
+        if (!world->links) {
+            fprintf(stderr, "Failed to allocate memory for links\n");
+        }
+    }
+    return world->links;
+}
+
+int addLink(PhysicsWorld* world, int a, int b, mfloat_t restLength, mfloat_t stiffness) {
+    LinkSet* links = worldLinks(world);
+    if (!links) return -1;
+    if (links->num_links >= MAX_LINKS) {
+        printf("Error: too many links (max %d)\n", MAX_LINKS);
+        return -1;
+    }
+    if (a == b || a < 0 || b < 0 || a >= NUM_PARTICLES || b >= NUM_PARTICLES) {
+        return -1;
+    }
+
+    if (restLength < 0) {
+        const mfloat_t* pa = world->particles[a].curr_position;
+        const mfloat_t* pb = world->particles[b].curr_position;
+        mfloat_t axis[VEC2_SIZE] = {wrapSeparation(pb[0] - pa[0], periodicWrap(world, 0)),
+                                    wrapSeparation(pb[1] - pa[1], periodicWrap(world, 1))};
+        restLength = vec2_length(axis);
+    }
+
+    int i = links->num_links;
+    links->link_a[i] = a;
+    links->link_b[i] = b;
+    links->link_rest_length[i] = restLength;
+    links->link_stiffness[i] = stiffness;
+    links->links_dirty = 1;
+    world->constraint_refs[a]++;
+    world->constraint_refs[b]++;
+    return links->num_links++;
+}
+
+void clearLinks(PhysicsWorld* world) {
+    LinkSet* links = world->links;
+    if (!links) return;
+    for (int i = 0; i < links->num_links; i++) {
+        world->constraint_refs[links->link_a[i]]--;
+        world->constraint_refs[links->link_b[i]]--;
+    }
+    links->num_links = 0;
+    links->num_link_colors = 0;
+    links->overflow_start = 0;
+    links->links_dirty = 0;
+}
+
+void colorLinks(LinkSet* links) {
+    for (int i = 0; i < NUM_PARTICLES; i++) {
+        links->particle_color_mask[i] = 0;
+    }
+
+    // Greedy coloring: give each link the lowest color not already used by
+    // another link on either of its particles
+    int color_counts[MAX_LINK_COLORS + 1] = {0};
+    links->num_link_colors = 0;
+    for (int i = 0; i < links->num_links; i++) {
+        uint32_t used = links->particle_color_mask[links->link_a[i]] | links->particle_color_mask[links->link_b[i]];
+        int color = OVERFLOW_COLOR;
+        for (int c = 0; c < MAX_LINK_COLORS; c++) {
+            if (!(used & (UINT32_C(1) << c))) {
+                color = c;
+                break;
+            }
+        }
+        if (color != OVERFLOW_COLOR) {
+            links->particle_color_mask[links->link_a[i]] |= UINT32_C(1) << color;
+            links->particle_color_mask[links->link_b[i]] |= UINT32_C(1) << color;
+            if (color + 1 > links->num_link_colors) links->num_link_colors = color + 1;
+        }
+        links->link_color[i] = (unsigned char)color;
+        color_counts[color]++;
+    }
+
+    // Counting sort into contiguous color batches, overflow last
+    int next[MAX_LINK_COLORS + 1];
+    int offset = 0;
+    for (int c = 0; c < links->num_link_colors; c++) {
+        links->link_color_offsets[c] = offset;
+        next[c] = offset;
+        offset += color_counts[c];
+    }
+    links->link_color_offsets[links->num_link_colors] = offset;
+    links->overflow_start = offset;
+    next[OVERFLOW_COLOR] = offset;
+
+    for (int i = 0; i < links->num_links; i++) {
+        int dst = next[links->link_color[i]]++;
+        links->sorted_a[dst] = links->link_a[i];
+        links->sorted_b[dst] = links->link_b[i];
+        links->sorted_rest_length[dst] = links->link_rest_length[i];
+        links->sorted_stiffness[dst] = links->link_stiffness[i];
+    }
+    for (int i = 0; i < links->num_links; i++) {
+        links->link_a[i] = links->sorted_a[i];
+        links->link_b[i] = links->sorted_b[i];
+        links->link_rest_length[i] = links->sorted_rest_length[i];
+        links->link_stiffness[i] = links->sorted_stiffness[i];
+    }
+
+    links->links_dirty = 0;
+}
+
+static inline void solveLink(PhysicsWorld* world, const LinkSet* links, int i, const mfloat_t* wrap) {
+    Particle* p1 = &world->particles[links->link_a[i]];
+    Particle* p2 = &world->particles[links->link_b[i]];
+    mfloat_t dx = wrapSeparation(p2->curr_position[0] - p1->curr_position[0], wrap[0]);
+    mfloat_t dy = wrapSeparation(p2->curr_position[1] - p1->curr_position[1], wrap[1]);
+    mfloat_t dist = MSQRT(dx * dx + dy * dy);
+
+    // Links touching a particle that has not spawned yet get zero weight
+    mfloat_t active = (mfloat_t)(links->link_a[i] < world->active_particles && links->link_b[i] < world->active_particles);
+    mfloat_t correction = 0.5f * links->link_stiffness[i] * active * (dist - links->link_rest_length[i]) / (dist + MFLT_EPSILON);
+
+    p1->curr_position[0] += dx * correction;
+    p1->curr_position[1] += dy * correction;
+    p2->curr_position[0] -= dx * correction;
+    p2->curr_position[1] -= dy * correction;
+}
+
+void solveLinks(PhysicsWorld* world) {
+    LinkSet* links = world->links;
+    if (!links || links->num_links == 0) return;
+    if (links->links_dirty) colorLinks(links);
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    // Links inside one color never share a particle, so each batch is free
+    // of write conflicts
+    for (int c = 0; c < links->num_link_colors; c++) {
+        int begin = links->link_color_offsets[c];
+        int end = links->link_color_offsets[c + 1];
+        #pragma omp parallel for if (end - begin > PARALLEL_BATCH_THRESHOLD)
+        for (int i = begin; i < end; i++) {
+            solveLink(world, links, i, wrap);
+        }
+    }
+
+    // Overflow links may share particles, so they must run one at a time
+    for (int i = links->overflow_start; i < links->num_links; i++) {
+        solveLink(world, links, i, wrap);
+    }
+}
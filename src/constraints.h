@@ -0,0 +1,59 @@
+#ifndef CONSTRAINTS_H
+#define CONSTRAINTS_H
+
+#include <stdint.h>
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_LINKS 400000
+#define MAX_LINK_COLORS 32 // Colors are tracked as a 32-bit mask per particle
+
+#define LINK_RIGID 1.0f // Stiffness of an inextensible link
+
+// Distance constraints are stored as flat SoA arrays. After coloring, links
+// are sorted so that every color occupies a contiguous range
+// [link_color_offsets[c], link_color_offsets[c + 1]) and no two links in
+// the same range share a particle.
+typedef struct LinkSet {
+    int link_a[MAX_LINKS];
+    int link_b[MAX_LINKS];
+    mfloat_t link_rest_length[MAX_LINKS];
+    mfloat_t link_stiffness[MAX_LINKS];
+    int num_links;
+    int num_link_colors;
+    int link_color_offsets[MAX_LINK_COLORS + 1];
+
+    // Links that did not fit in any color (a particle with more than
+    // MAX_LINK_COLORS links) live after the last color batch and are
+    // solved sequentially.
+    int overflow_start;
+    int links_dirty;
+
+    // Scratch used while coloring
+    uint32_t particle_color_mask[NUM_PARTICLES];
+    unsigned char link_color[MAX_LINKS];
+    int sorted_a[MAX_LINKS];
+    int sorted_b[MAX_LINKS];
+    mfloat_t sorted_rest_length[MAX_LINKS];
+    mfloat_t sorted_stiffness[MAX_LINKS];
+} LinkSet;
+
+// Adds a link between particles a and b. stiffness is in (0, 1], where 1 is
+// a rigid link and smaller values behave like springs. A negative
+// restLength uses the current distance between the particles. In the
+// periodic box links measure to the nearest image, like contacts do.
+// Returns the link's current index, or -1 if the link could not be added.
+// The next step recolors the links and reorders them, so the index only
+// holds until then.
+int addLink(PhysicsWorld* world, int a, int b, mfloat_t restLength, mfloat_t stiffness);
+void clearLinks(PhysicsWorld* world);
+
+// Greedily colors the link graph and sorts links into color batches. Called
+// lazily by solveLinks whenever links were added since the last coloring.
+void colorLinks(LinkSet* links);
+
+// Projects every link whose particles are both active, one color batch at
+// a time. Links inside a batch are independent and run in parallel.
+void solveLinks(PhysicsWorld* world);
+
+#endif
@@ -0,0 +1,345 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // fork, waitpid
+#endif
+
+#include "domain.h"
+#include "ensemble.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+DomainRank* createDomainRank(DomainTransport* transport) {
+    DomainRank* rank = (DomainRank*)calloc(1, sizeof(DomainRank));
+    if (!rank) {
+        fprintf(stderr, "Failed to allocate memory for domain rank\n");
+        return NULL;
+    }
+    rank->world = createPhysicsWorld();
+    rank->send_left = (Particle*)malloc(DOMAIN_MAILBOX_CAPACITY * sizeof(Particle));
+    rank->send_right = (Particle*)malloc(DOMAIN_MAILBOX_CAPACITY * sizeof(Particle));
+    if (!rank->world || !rank->send_left || !rank->send_right) {
+        fprintf(stderr, "Failed to allocate memory for domain rank\n");
+        destroyDomainRank(rank);
+        return NULL;
+    }
+    rank->transport = transport;
+
+    const mfloat_t min_x = rank->world->container_pos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    const mfloat_t width = 2.0f * (CONTAINER_SIZE - CONTAINER_BORDER_WIDTH) / transport->num_ranks;
+    rank->slab_min_x = min_x + transport->rank * width;
+    rank->slab_max_x = min_x + (transport->rank + 1) * width;
+    return rank;
+}
+
+void destroyDomainRank(DomainRank* rank) {
+    if (!rank) return;
+    destroyPhysicsWorld(rank->world);
+    free(rank->send_left);
+    free(rank->send_right);
+    free(rank);
+}
+
+static inline int hasLeft(const DomainRank* rank) {
+    return rank->transport->rank > 0;
+}
+
+static inline int hasRight(const DomainRank* rank) {
+    return rank->transport->rank < rank->transport->num_ranks - 1;
+}
+
+// Outer slabs own everything beyond the container edge
+static inline int ownsX(const DomainRank* rank, mfloat_t x) {
+    return (!hasLeft(rank) || x >= rank->slab_min_x) && (!hasRight(rank) || x < rank->slab_max_x);
+}
+
+int addDomainParticle(DomainRank* rank, const mfloat_t* position, mfloat_t radius) {
+    if (!ownsX(rank, position[0])) return 0;
+    if (rank->owned >= NUM_PARTICLES) {
+        printf("Error: slab %d cannot hold more than %d particles\n", rank->transport->rank, NUM_PARTICLES);
+        return 0;
+    }
+    initParticleSlot(rank->world, rank->owned);
+    Particle* p = &rank->world->particles[rank->owned++];
+    memset(p, 0, sizeof(Particle));
+    vec2(p->curr_position, position[0], position[1]);
+    vec2(p->old_position, position[0], position[1]);
+    p->radius = radius;
+    p->temperature = AMBIENT_TEMPERATURE;
+    rank->world->active_particles = rank->owned;
+    return 1;
+}
+
+static void postToNeighbours(DomainRank* rank, int channel, int numLeft, int numRight) {
+    DomainTransport* t = rank->transport;
+    if (hasLeft(rank) && t->post(t, t->rank - 1, channel, rank->send_left, numLeft) < 0) {
+        printf("Error: slab %d dropped %d particles bound for slab %d\n", t->rank, numLeft, t->rank - 1);
+    }
+    if (hasRight(rank) && t->post(t, t->rank + 1, channel, rank->send_right, numRight) < 0) {
+        printf("Error: slab %d dropped %d particles bound for slab %d\n", t->rank, numRight, t->rank + 1);
+    }
+}
+
+// Appends what the neighbours posted on channel after the first count
+// particles and returns the new count
+static int collectFromNeighbours(DomainRank* rank, int channel, int count) {
+    DomainTransport* t = rank->transport;
+    Particle* particles = rank->world->particles;
+    const int first = count;
+    if (hasLeft(rank)) {
+        count += t->collect(t, t->rank - 1, channel, &particles[count], NUM_PARTICLES - count);
+    }
+    if (hasRight(rank)) {
+        count += t->collect(t, t->rank + 1, channel, &particles[count], NUM_PARTICLES - count);
+    }
+    // Only the Particle crosses the transport; the rest of the slot starts fresh
+    for (int i = first; i < count; i++) initParticleSlot(rank->world, i);
+    return count;
+}
+
+// Returns the number of halo particles that did not fit in a mailbox
+static int exchangeHalos(DomainRank* rank) {
+    const Particle* particles = rank->world->particles;
+    int num_left = 0;
+    int num_right = 0;
+    int dropped = 0;
+    for (int i = 0; i < rank->owned; i++) {
+        mfloat_t x = particles[i].curr_position[0];
+        if (hasLeft(rank) && x < rank->slab_min_x + HALO_WIDTH) {
+            if (num_left < DOMAIN_MAILBOX_CAPACITY) rank->send_left[num_left++] = particles[i];
+            else dropped++;
+        }
+        if (hasRight(rank) && x >= rank->slab_max_x - HALO_WIDTH) {
+            if (num_right < DOMAIN_MAILBOX_CAPACITY) rank->send_right[num_right++] = particles[i];
+            else dropped++;
+        }
+    }
+    if (dropped > 0) {
+        printf("Error: slab %d could not mirror %d halo particles (mailbox holds %d)\n",
+               rank->transport->rank, dropped, DOMAIN_MAILBOX_CAPACITY);
+    }
+    postToNeighbours(rank, CHANNEL_HALO, num_left, num_right);
+    rank->transport->exchange(rank->transport, CHANNEL_HALO);
+    rank->world->active_particles = collectFromNeighbours(rank, CHANNEL_HALO, rank->owned);
+    return dropped;
+}
+
+// Hands owned particles that left the slab to the neighbour on that side
+// and takes in the ones it handed over. Particles are assumed to cross at
+// most one slab per substep. Returns the number of particles left outside
+// the slab because a mailbox was full.
+static int migrateParticles(DomainRank* rank) {
+    Particle* particles = rank->world->particles;
+    int num_left = 0;
+    int num_right = 0;
+    int stranded = 0;
+    for (int i = 0; i < rank->owned;) {
+        mfloat_t x = particles[i].curr_position[0];
+        int leaves_left = hasLeft(rank) && x < rank->slab_min_x;
+        int leaves_right = hasRight(rank) && x >= rank->slab_max_x;
+        int to_left = leaves_left && num_left < DOMAIN_MAILBOX_CAPACITY;
+        int to_right = leaves_right && num_right < DOMAIN_MAILBOX_CAPACITY;
+        if (!to_left && !to_right) {
+            stranded += leaves_left || leaves_right;
+            i++;
+            continue;
+        }
+        // Order of owned particles does not matter, so fill the gap from the end
+        Particle leaving = particles[i];
+        if (removeParticle(rank->world, i) < 0) {
+            // Held by a constraint; it stays with this rank
+            i++;
+            continue;
+        }
+        if (to_left) {
+            rank->send_left[num_left++] = leaving;
+        } else {
+            rank->send_right[num_right++] = leaving;
+        }
+        rank->owned--;
+    }
+    if (stranded > 0) {
+        printf("Error: slab %d kept %d particles outside its slab (mailbox holds %d)\n",
+               rank->transport->rank, stranded, DOMAIN_MAILBOX_CAPACITY);
+    }
+    postToNeighbours(rank, CHANNEL_MIGRATE, num_left, num_right);
+    rank->transport->exchange(rank->transport, CHANNEL_MIGRATE);
+    rank->owned = collectFromNeighbours(rank, CHANNEL_MIGRATE, rank->owned);
+    rank->world->active_particles = rank->owned;
+    return stranded;
+}
+
+int stepDomainRank(DomainRank* rank, float dt, int substeps) {
+    const float sub_dt = dt / substeps;
+    int overflow = 0;
+    for (int s = 0; s < substeps; s++) {
+        overflow += exchangeHalos(rank);
+        stepPhysicsWorld(rank->world, sub_dt, 1);
+        // Ghosts were stepped only to push on owned particles
+        rank->world->active_particles = rank->owned;
+        overflow += migrateParticles(rank);
+    }
+    return overflow > 0 ? -1 : 0;
+}
+
+#ifdef _WIN32
+
+int runDomainSimulation(const DomainRun* run, const char* outputPath) {
+    (void)run;
+    (void)outputPath;
+    printf("Error: domain decomposition needs fork and POSIX shared memory\n");
+    return -1;
+}
+
+#else
+
+static double wallTime(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static int validateDomainRun(const DomainRun* run) {
+    if (run->num_ranks < 1 || run->num_ranks > MAX_DOMAIN_RANKS) {
+        printf("Error: rank count must be in [1, %d]\n", MAX_DOMAIN_RANKS);
+        return 0;
+    }
+    if (run->radius <= 0.0f || run->radius > PARTICLE_RADIUS) {
+        printf("Error: radius must be in (0, %g]\n", PARTICLE_RADIUS);
+        return 0;
+    }
+    if (run->num_particles < 1 || run->num_particles > run->num_ranks * NUM_PARTICLES / 2) {
+        printf("Error: %d ranks hold at most %d particles\n", run->num_ranks, run->num_ranks * NUM_PARTICLES / 2);
+        return 0;
+    }
+    if (run->substeps < 1 || run->frames < 0) {
+        printf("Error: a domain run needs at least one substep and a non-negative frame count\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Each rank appends its owned particles to outputPath in rank order
+static int writeDomainRank(const DomainRank* rank, const DomainRun* run, const char* outputPath, double seconds) {
+    DomainTransport* t = rank->transport;
+    int ok = 1;
+    for (int turn = 0; turn < t->num_ranks; turn++) {
+        if (turn == t->rank) {
+            FILE* file = fopen(outputPath, turn == 0 ? "w" : "a");
+            if (!file) {
+                printf("Error: could not open domain output %s\n", outputPath);
+                ok = 0;
+            } else {
+                if (turn == 0) {
+                    fprintf(file, "domain ranks %d particles %d radius %g substeps %d frames %d seconds %.6f\n",
+                            run->num_ranks, run->num_particles, run->radius, run->substeps, run->frames, seconds);
+                }
+                fprintf(file, "slab %d min_x %g max_x %g particles %d\n",
+                        t->rank, rank->slab_min_x, rank->slab_max_x, rank->owned);
+                const mfloat_t sub_dt = ENSEMBLE_DT / run->substeps;
+                for (int i = 0; i < rank->owned; i++) {
+                    const Particle* p = &rank->world->particles[i];
+                    fprintf(file, "%.6f %.6f %.6f %.6f\n", p->curr_position[0], p->curr_position[1],
+                            (p->curr_position[0] - p->old_position[0]) / sub_dt,
+                            (p->curr_position[1] - p->old_position[1]) / sub_dt);
+                }
+                fclose(file);
+            }
+        }
+        t->barrier(t);
+    }
+    return ok;
+}
+
+static int runDomainRank(DomainTransport* transport, const DomainRun* run, const char* outputPath) {
+#ifdef _OPENMP
+    // Share the cores between the ranks rather than oversubscribing them
+    int threads = omp_get_num_procs() / transport->num_ranks;
+    omp_set_num_threads(threads > 0 ? threads : 1);
+#endif
+    // Every rank allocates and first touches its own world, so on a NUMA
+    // box the OS places it on the node the rank runs on
+    DomainRank* rank = createDomainRank(transport);
+    if (!rank) {
+        // Make the same collective calls with nothing to send, or the other
+        // ranks would block
+        for (int i = 0; i < run->frames * run->substeps; i++) {
+            transport->exchange(transport, CHANNEL_HALO);
+            transport->exchange(transport, CHANNEL_MIGRATE);
+        }
+        for (int turn = 0; turn < transport->num_ranks + 2; turn++) transport->barrier(transport);
+        return 0;
+    }
+
+    for (int i = 0; i < run->num_particles; i++) {
+        mfloat_t position[VEC2_SIZE];
+        latticePosition(rank->world->container_pos, run->radius, i, position);
+        addDomainParticle(rank, position, run->radius);
+    }
+    transport->barrier(transport);
+    double start = wallTime();
+    int stepped = 1;
+    for (int frame = 0; frame < run->frames; frame++) {
+        // Keep stepping after an overflow so the other ranks' collective
+        // calls still match, but fail the run
+        if (stepDomainRank(rank, ENSEMBLE_DT, run->substeps) < 0) stepped = 0;
+    }
+    transport->barrier(transport);
+    double seconds = wallTime() - start;
+    if (transport->rank == 0) {
+        printf("Stepped %d particles on %d ranks in %.3f s\n", run->num_particles, run->num_ranks, seconds);
+    }
+    int ok = writeDomainRank(rank, run, outputPath, seconds) && stepped;
+    destroyDomainRank(rank);
+    return ok;
+}
+
+int runDomainSimulation(const DomainRun* run, const char* outputPath) {
+    if (!validateDomainRun(run)) return -1;
+    DomainTransport* transport = createShmTransport(run->num_ranks);
+    if (!transport) return -1;
+
+    // Fork before any OpenMP region so no rank inherits a broken thread pool
+    fflush(stdout);
+    pid_t children[MAX_DOMAIN_RANKS];
+    int num_children = 0;
+    for (int r = 1; r < run->num_ranks; r++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            transport->rank = r;
+            int ok = runDomainRank(transport, run, outputPath);
+            transport->destroy(transport);
+            fflush(stdout);
+            _exit(ok ? 0 : 1);
+        }
+        if (pid < 0) {
+            // The barrier counts every rank, so none can run without the rest
+            printf("Error: could only start %d of %d ranks\n", r, run->num_ranks);
+            for (int c = 0; c < num_children; c++) kill(children[c], SIGKILL);
+            for (int c = 0; c < num_children; c++) waitpid(children[c], NULL, 0);
+            transport->destroy(transport);
+            return -1;
+        }
+        children[num_children++] = pid;
+    }
+
+    int ok = runDomainRank(transport, run, outputPath);
+    for (int c = 0; c < num_children; c++) {
+        int status = 0;
+        if (waitpid(children[c], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = 0;
+    }
+    transport->destroy(transport);
+    return ok ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include "mathc.h"
+#include "physics.h"
+#include "transport.h"
+
+#define MAX_DOMAIN_RANKS 64
+#define HALO_WIDTH (2 * GRID_CELL_SIZE) // Owned particles this close to a slab edge are mirrored
+
+// One process's share of a world split into slabs along x. The world holds
+// the owned particles in [0, owned); during a substep the neighbours' halo
+// particles follow them as ghosts, which are stepped like any other
+// particle and then dropped. A contact between an owned particle and a
+// ghost moves each side by half, and the neighbour resolves the same pair
+// from its side, so both halves of the correction land.
+typedef struct {
+    PhysicsWorld* world;
+    DomainTransport* transport;
+    mfloat_t slab_min_x; // Owned range is [slab_min_x, slab_max_x)
+    mfloat_t slab_max_x;
+    int owned;
+    Particle* send_left;  // Scratch for outgoing halos and migrants
+    Particle* send_right;
+} DomainRank;
+
+// Settings of a decomposed run. Every rank starts from its part of the
+// same lattice of particles dropped into the box container.
+typedef struct {
+    int num_ranks;
+    int num_particles;
+    mfloat_t radius; // At most PARTICLE_RADIUS, the grid cell size assumes it
+    int substeps;
+    int frames; // Steps of ENSEMBLE_DT
+} DomainRun;
+
+// Creates the rank for transport->rank, owning an equal-width slab of the
+// box container interior; the outer slabs extend to infinity. Returns NULL
+// if memory runs out.
+DomainRank* createDomainRank(DomainTransport* transport);
+void destroyDomainRank(DomainRank* rank);
+
+// Adds a particle if it lies in this rank's slab. Returns 1 if it was kept.
+int addDomainParticle(DomainRank* rank, const mfloat_t* position, mfloat_t radius);
+
+// Collective: advances the whole decomposed world by dt split into
+// substeps, exchanging halos before and migrating particles after each
+// substep. Every rank must call it with the same arguments. Returns -1 if a
+// mailbox overflowed, which loses contacts across the slab edge or leaves
+// particles outside their slab. The step still runs to the end on every
+// rank so the collective calls stay matched.
+int stepDomainRank(DomainRank* rank, float dt, int substeps);
+
+// Forks run->num_ranks processes over a shared memory transport, steps the
+// run and writes every particle's (x, y, vx, vy) to outputPath, slab by
+// slab. Needs POSIX. Returns 0 on success, -1 on failure.
+int runDomainSimulation(const DomainRun* run, const char* outputPath);
+
+#endif
@@ -0,0 +1,351 @@
+#include "ensemble.h"
+#include "batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define LATTICE_SPACING 2.2f // Initial gap between particle centers, in radii
+#define PILE_COMPRESSION 0.5f // Deep piles squeeze centers to this share of the contact distance
+
+static double wallTime(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+int loadEnsembleRuns(const char* path, EnsembleRun* runs, int maxRuns) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Error: could not open ensemble config %s\n", path);
+        return -1;
+    }
+
+    char line[256];
+    int count = 0;
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char first = 0;
+        if (sscanf(line, " %c", &first) != 1 || first == '#') continue;
+        if (count >= maxRuns) {
+            printf("Error: too many ensemble runs (max %d)\n", maxRuns);
+            fclose(file);
+            return -1;
+        }
+        EnsembleRun* run = &runs[count];
+        if (sscanf(line, "%f %f %f %f %d %d %d", &run->gravity, &run->collision_response, &run->restitution,
+                   &run->radius, &run->substeps, &run->num_particles, &run->frames) != 7) {
+            printf("Error: %s:%d expects gravity response restitution radius substeps particles frames\n",
+                   path, line_number);
+            fclose(file);
+            return -1;
+        }
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Particles of radius r that fit in one grid cell when a pile packs them
+// hexagonally at PILE_COMPRESSION of the contact distance
+static int cellOccupancy(mfloat_t r) {
+    mfloat_t spacing = PILE_COMPRESSION * 2.0f * r;
+    return (int)((GRID_CELL_SIZE / spacing + 1.0f) * (GRID_CELL_SIZE / (0.8660254f * spacing) + 1.0f));
+}
+
+static int validateRun(const EnsembleRun* run, int index) {
+    if (run->radius <= 0.0f || run->radius > PARTICLE_RADIUS) {
+        printf("Error: run %d radius must be in (0, %g]\n", index, PARTICLE_RADIUS);
+        return 0;
+    }
+    if (cellOccupancy(run->radius) > MAX_PARTICLES_PER_CELL) {
+        printf("Error: run %d radius %g is too small, a grid cell holds at most %d particles\n",
+               index, run->radius, MAX_PARTICLES_PER_CELL);
+        return 0;
+    }
+    if (run->restitution < 0.0f || run->restitution > 1.0f) {
+        printf("Error: run %d restitution must be in [0, 1]\n", index);
+        return 0;
+    }
+    if (run->num_particles < 1 || run->num_particles > NUM_PARTICLES) {
+        printf("Error: run %d particle count must be in [1, %d]\n", index, NUM_PARTICLES);
+        return 0;
+    }
+    if (run->substeps < 1 || run->frames < 0) {
+        printf("Error: run %d needs at least one substep and a non-negative frame count\n", index);
+        return 0;
+    }
+    return 1;
+}
+
+void latticePosition(const mfloat_t* containerPos, mfloat_t r, int i, mfloat_t* position) {
+    const mfloat_t spacing = LATTICE_SPACING * r;
+    const mfloat_t min_x = containerPos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + r;
+    const mfloat_t max_x = containerPos[0] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH - r;
+    const mfloat_t min_y = containerPos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + r;
+    const int cols = (int)((max_x - min_x - 0.5f * spacing) / spacing) + 1;
+    int row = i / cols;
+    int col = i % cols;
+    position[0] = min_x + (col + 0.5f * (row & 1)) * spacing;
+    position[1] = min_y + row * spacing * 0.8660254f;
+}
+
+// Fills stats from the (x, y, vx, vy) rows of a finished run
+static void summarizeState(const float* state, int numParticles, mfloat_t floorY, EnsembleStats* stats) {
+    mfloat_t height_sum = 0.0f;
+    stats->max_height = 0.0f;
+    stats->kinetic_energy = 0.0f;
+    stats->max_speed = 0.0f;
+    for (int i = 0; i < numParticles; i++) {
+        const float* s = &state[4 * i];
+        mfloat_t speed_sq = s[2] * s[2] + s[3] * s[3];
+        mfloat_t height = s[1] - floorY;
+        height_sum += height;
+        stats->max_height = MFMAX(stats->max_height, height);
+        stats->kinetic_energy += 0.5f * speed_sq;
+        stats->max_speed = MFMAX(stats->max_speed, MSQRT(speed_sq));
+    }
+    stats->mean_height = height_sum / numParticles;
+}
+
+// Runs one configuration and stores (x, y, vx, vy) per particle in state
+static int simulateRun(const EnsembleRun* run, EnsembleStats* stats, float* state) {
+    PhysicsWorld* world = createPhysicsWorld();
+    if (!world) return 0;
+    world->gravity = run->gravity;
+    world->collision_response = run->collision_response;
+    world->container_response = run->restitution;
+    for (int i = 0; i < run->num_particles; i++) {
+        Particle* p = &world->particles[i];
+        latticePosition(world->container_pos, run->radius, i, p->curr_position);
+        vec2(p->old_position, p->curr_position[0], p->curr_position[1]);
+        vec2_zero(p->acceleration);
+        p->radius = run->radius;
+        p->temperature = AMBIENT_TEMPERATURE;
+    }
+    world->active_particles = run->num_particles;
+
+    double start = wallTime();
+    for (int frame = 0; frame < run->frames; frame++) {
+        stepPhysicsWorld(world, ENSEMBLE_DT, run->substeps);
+    }
+    stats->seconds = wallTime() - start;
+
+    const mfloat_t sub_dt = ENSEMBLE_DT / run->substeps;
+    for (int i = 0; i < run->num_particles; i++) {
+        const Particle* p = &world->particles[i];
+        state[4 * i] = p->curr_position[0];
+        state[4 * i + 1] = p->curr_position[1];
+        state[4 * i + 2] = (p->curr_position[0] - p->old_position[0]) / sub_dt;
+        state[4 * i + 3] = (p->curr_position[1] - p->old_position[1]) / sub_dt;
+    }
+    summarizeState(state, run->num_particles, world->container_pos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH, stats);
+
+    destroyPhysicsWorld(world);
+    return 1;
+}
+
+// Runs up to BATCH_LANES configurations with equal substeps and frames in
+// one lockstep batch. The wall time is shared by every run in the batch.
+static int simulateBatch(const EnsembleRun* runs, const int* indices, int numRuns,
+                         EnsembleStats* stats, float** states) {
+    WorldBatch* batch = createWorldBatch();
+    if (!batch) return 0;
+    for (int lane = 0; lane < numRuns; lane++) {
+        const EnsembleRun* run = &runs[indices[lane]];
+        setBatchLane(batch, lane, run->num_particles, run->gravity, run->collision_response, run->restitution,
+                     run->radius);
+        for (int i = 0; i < run->num_particles; i++) {
+            mfloat_t position[VEC2_SIZE];
+            latticePosition(batch->container_pos, run->radius, i, position);
+            setBatchParticle(batch, lane, i, position);
+        }
+    }
+
+    const EnsembleRun* first = &runs[indices[0]];
+    double start = wallTime();
+    for (int frame = 0; frame < first->frames; frame++) {
+        stepWorldBatch(batch, ENSEMBLE_DT, first->substeps);
+    }
+    double seconds = wallTime() - start;
+
+    const mfloat_t floor_y = batch->container_pos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    for (int lane = 0; lane < numRuns; lane++) {
+        int r = indices[lane];
+        readBatchLane(batch, lane, ENSEMBLE_DT / first->substeps, states[r]);
+        summarizeState(states[r], runs[r].num_particles, floor_y, &stats[r]);
+        stats[r].seconds = seconds;
+    }
+
+    destroyWorldBatch(batch);
+    return 1;
+}
+
+// A unit of parallel work: one run in its own world, or a lockstep batch
+typedef struct {
+    double cost;
+    bool batched;
+    int num_runs;
+    int runs[BATCH_LANES];
+} EnsembleWork;
+
+// Orders work by decreasing cost so the longest start first and short runs
+// fill the gaps at the end
+static int compareCost(const void* a, const void* b) {
+    double cost_a = ((const EnsembleWork*)a)->cost;
+    double cost_b = ((const EnsembleWork*)b)->cost;
+    return (cost_a < cost_b) - (cost_a > cost_b);
+}
+
+typedef struct {
+    int substeps;
+    int frames;
+    int run;
+} BatchKey;
+
+// Orders runs by substeps then frames, the settings a batch shares
+static int compareBatchKey(const void* a, const void* b) {
+    const BatchKey* x = (const BatchKey*)a;
+    const BatchKey* y = (const BatchKey*)b;
+    if (x->substeps != y->substeps) return x->substeps < y->substeps ? -1 : 1;
+    if (x->frames != y->frames) return x->frames < y->frames ? -1 : 1;
+    return x->run - y->run;
+}
+
+// Splits the runs into work items. With lockstep, runs small enough for a
+// batch are grouped by matching substeps and frames. Returns the number of
+// items written to work, or -1 if memory runs out.
+static int planEnsembleWork(const EnsembleRun* runs, int numRuns, bool lockstep, EnsembleWork* work) {
+    BatchKey* keys = (BatchKey*)malloc(numRuns * sizeof(BatchKey));
+    if (!keys) {
+        fprintf(stderr, "Failed to allocate memory for the ensemble plan\n");
+        return -1;
+    }
+
+    int num_work = 0;
+    int num_keys = 0;
+    for (int r = 0; r < numRuns; r++) {
+        if (lockstep && runs[r].num_particles <= BATCH_MAX_PARTICLES) {
+            keys[num_keys].substeps = runs[r].substeps;
+            keys[num_keys].frames = runs[r].frames;
+            keys[num_keys].run = r;
+            num_keys++;
+        } else {
+            EnsembleWork* item = &work[num_work++];
+            item->cost = (double)runs[r].num_particles * runs[r].substeps * runs[r].frames;
+            item->batched = false;
+            item->num_runs = 1;
+            item->runs[0] = r;
+        }
+    }
+
+    qsort(keys, num_keys, sizeof(BatchKey), compareBatchKey);
+    for (int k = 0; k < num_keys; k++) {
+        bool same_key = k > 0 && keys[k].substeps == keys[k - 1].substeps && keys[k].frames == keys[k - 1].frames;
+        if (!same_key || work[num_work - 1].num_runs == BATCH_LANES) {
+            EnsembleWork* item = &work[num_work++];
+            item->cost = 0.0;
+            item->batched = true;
+            item->num_runs = 0;
+        }
+        // A batch costs as much as its largest lane
+        EnsembleWork* item = &work[num_work - 1];
+        const EnsembleRun* run = &runs[keys[k].run];
+        double cost = (double)run->num_particles * run->substeps * run->frames;
+        if (cost > item->cost) item->cost = cost;
+        item->runs[item->num_runs++] = keys[k].run;
+    }
+
+    free(keys);
+    return num_work;
+}
+
+int runEnsemble(const EnsembleRun* runs, int numRuns, const char* outputPath, bool lockstep) {
+    for (int r = 0; r < numRuns; r++) {
+        if (!validateRun(&runs[r], r)) return -1;
+    }
+
+    FILE* output = fopen(outputPath, "w");
+    if (!output) {
+        printf("Error: could not open ensemble output %s\n", outputPath);
+        return -1;
+    }
+
+    EnsembleWork* work = (EnsembleWork*)malloc(numRuns * sizeof(EnsembleWork));
+    int* succeeded = (int*)calloc(numRuns, sizeof(int));
+    EnsembleStats* stats = (EnsembleStats*)malloc(numRuns * sizeof(EnsembleStats));
+    float** states = (float**)calloc(numRuns, sizeof(float*));
+    int num_work = -1;
+    if (work && succeeded && stats && states) {
+        num_work = planEnsembleWork(runs, numRuns, lockstep, work);
+    } else {
+        fprintf(stderr, "Failed to allocate memory for ensemble results\n");
+    }
+    if (num_work < 0) {
+        free(work);
+        free(succeeded);
+        free(stats);
+        free(states);
+        fclose(output);
+        return -1;
+    }
+    qsort(work, num_work, sizeof(EnsembleWork), compareCost);
+
+    // One world or batch per thread; they share nothing, so no locking is needed
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int k = 0; k < num_work; k++) {
+        const EnsembleWork* item = &work[k];
+        bool allocated = true;
+        for (int n = 0; n < item->num_runs; n++) {
+            int r = item->runs[n];
+            states[r] = (float*)malloc(runs[r].num_particles * 4 * sizeof(float));
+            allocated = allocated && states[r];
+        }
+        if (!allocated) {
+            fprintf(stderr, "Failed to allocate memory for ensemble run %d\n", item->runs[0]);
+            continue;
+        }
+        int ok = item->batched
+            ? simulateBatch(runs, item->runs, item->num_runs, stats, states)
+            : simulateRun(&runs[item->runs[0]], &stats[item->runs[0]], states[item->runs[0]]);
+        for (int n = 0; n < item->num_runs; n++) {
+            succeeded[item->runs[n]] = ok;
+        }
+    }
+
+    // Written in run order so the file does not depend on thread timing
+    int failures = 0;
+    fprintf(output, "# ensemble %d runs, dt %g\n", numRuns, ENSEMBLE_DT);
+    for (int r = 0; r < numRuns; r++) {
+        const EnsembleRun* run = &runs[r];
+        fprintf(output, "run %d gravity %g response %g restitution %g radius %g substeps %d particles %d frames %d\n",
+                r, run->gravity, run->collision_response, run->restitution, run->radius, run->substeps,
+                run->num_particles, run->frames);
+        if (!succeeded[r]) {
+            fprintf(output, "failed\n");
+            failures++;
+            continue;
+        }
+        fprintf(output, "stats mean_height %g max_height %g kinetic_energy %g max_speed %g seconds %.3f\n",
+                stats[r].mean_height, stats[r].max_height, stats[r].kinetic_energy, stats[r].max_speed, stats[r].seconds);
+        for (int i = 0; i < run->num_particles; i++) {
+            const float* s = &states[r][4 * i];
+            fprintf(output, "%g %g %g %g\n", s[0], s[1], s[2], s[3]);
+        }
+    }
+    fclose(output);
+
+    for (int r = 0; r < numRuns; r++) {
+        free(states[r]);
+    }
+    free(work);
+    free(succeeded);
+    free(stats);
+    free(states);
+    return failures ? -1 : 0;
+}
@@ -0,0 +1,51 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_ENSEMBLE_RUNS 4096
+#define ENSEMBLE_DT (1.0f / 60.0f)
+
+// One run of a parameter sweep. Every run starts from the same lattice of
+// particles dropped into the box container.
+typedef struct {
+    mfloat_t gravity;
+    mfloat_t collision_response; // Share of each overlap removed per substep
+    mfloat_t restitution;        // Share of the velocity kept when bouncing off a wall
+    mfloat_t radius;             // At most PARTICLE_RADIUS, the grid cell size assumes it
+    int substeps;
+    int num_particles;
+    int frames; // Steps of ENSEMBLE_DT
+} EnsembleRun;
+
+// Summary of a run's final state
+typedef struct {
+    mfloat_t mean_height;
+    mfloat_t max_height;
+    mfloat_t kinetic_energy; // Per unit particle mass, summed over particles
+    mfloat_t max_speed;
+    double seconds; // Wall time spent stepping
+} EnsembleStats;
+
+// Position of particle i in a hexagonal lattice of particles of radius r
+// filling the bottom of the box container centred at containerPos
+void latticePosition(const mfloat_t* containerPos, mfloat_t r, int i, mfloat_t* position);
+
+// Reads runs from a text file with one run per line:
+//   gravity collision_response restitution radius substeps num_particles frames
+// Blank lines and lines starting with '#' are skipped. Returns the number
+// of runs read, or -1 on failure.
+int loadEnsembleRuns(const char* path, EnsembleRun* runs, int maxRuns);
+
+// Steps every run in its own world, one world per thread at a time, and
+// writes each run's configuration, stats and final particle states to
+// outputPath in run order. Inner loops run single threaded unless nested
+// parallelism is enabled, so small worlds pack onto cores without
+// oversubscribing them. With lockstep, runs of at most BATCH_MAX_PARTICLES
+// that share substeps and frames are stepped BATCH_LANES at a time in a
+// WorldBatch, which models gravity, the box container and contacts only.
+// Returns 0 on success, -1 on failure.
+int runEnsemble(const EnsembleRun* runs, int numRuns, const char* outputPath, bool lockstep);
+
+#endif
@@ -0,0 +1,172 @@
+#include "events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void subscribeCollisionEvents(PhysicsWorld* world, mfloat_t minRelativeSpeed) {
+    if (!world->events) {
+        world->events = (EventStream*)calloc(1, sizeof(EventStream));
+        if (!world->events) {
+            fprintf(stderr, "Failed to allocate memory for the event stream\n");
+            return;
+        }
+    }
+    world->events->min_relative_speed = minRelativeSpeed;
+    world->events->enabled = true;
+}
+
+void unsubscribeCollisionEvents(PhysicsWorld* world) {
+    EventStream* stream = world->events;
+    if (!stream) return;
+    stream->enabled = false;
+    for (int t = 0; t < stream->num_thread_buffers; t++) {
+        free(stream->thread_buffers[t].events);
+    }
+    free(stream->thread_buffers);
+    stream->thread_buffers = NULL;
+    stream->num_thread_buffers = 0;
+    free(stream->collision_events);
+    stream->collision_events = NULL;
+    stream->num_collision_events = 0;
+    stream->merged_capacity = 0;
+}
+
+void clearCollisionEvents(PhysicsWorld* world) {
+    EventStream* stream = world->events;
+    if (!stream) return;
+    for (int t = 0; t < stream->num_thread_buffers; t++) {
+        stream->thread_buffers[t].count = 0;
+    }
+    stream->num_collision_events = 0;
+}
+
+// Makes sure every thread of a parallel region started by this step has a
+// buffer. Runs outside parallel regions, so the array may move.
+static bool reserveThreadBuffers(EventStream* stream) {
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    if (threads <= stream->num_thread_buffers) return true;
+    EventBuffer* grown = (EventBuffer*)realloc(stream->thread_buffers, threads * sizeof(EventBuffer));
+    if (!grown) {
+        fprintf(stderr, "Failed to allocate memory for collision event buffers\n");
+        return false;
+    }
+    for (int t = stream->num_thread_buffers; t < threads; t++) {
+        grown[t].events = NULL;
+        grown[t].count = 0;
+        grown[t].capacity = 0;
+    }
+    stream->thread_buffers = grown;
+    stream->num_thread_buffers = threads;
+    return true;
+}
+
+void beginCollisionEventStep(PhysicsWorld* world, float subDt) {
+    EventStream* stream = world->events;
+    if (!stream || !stream->enabled) return;
+    // Without a buffer per thread, record nothing this step
+    if (!reserveThreadBuffers(stream)) {
+        stream->threshold = INFINITY;
+        return;
+    }
+    stream->threshold = stream->min_relative_speed * subDt;
+    stream->speed_scale = 1.0f / subDt;
+}
+
+void recordCollisionEvent(EventStream* stream, int a, int b, mfloat_t penetration, mfloat_t closing) {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    EventBuffer* buffer = &stream->thread_buffers[thread];
+    if (buffer->count == buffer->capacity) {
+        int capacity = buffer->capacity ? 2 * buffer->capacity : 1024;
+        CollisionEvent* grown = (CollisionEvent*)realloc(buffer->events, capacity * sizeof(CollisionEvent));
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate memory for collision events\n");
+            return;
+        }
+        buffer->events = grown;
+        buffer->capacity = capacity;
+    }
+
+    CollisionEvent* event = &buffer->events[buffer->count++];
+    event->a = a < b ? a : b;
+    event->b = a < b ? b : a;
+    event->penetration = penetration;
+    event->relative_speed = closing * stream->speed_scale;
+}
+
+static int compareEvents(const void* lhs, const void* rhs) {
+    const CollisionEvent* x = (const CollisionEvent*)lhs;
+    const CollisionEvent* y = (const CollisionEvent*)rhs;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    if (x->b != y->b) return x->b < y->b ? -1 : 1;
+    return 0;
+}
+
+void endCollisionEventStep(PhysicsWorld* world) {
+    EventStream* stream = world->events;
+    if (!stream || !stream->enabled) return;
+
+    EventBuffer* thread_buffers = stream->thread_buffers;
+    CollisionEvent* collision_events = stream->collision_events;
+    // Earlier steps' events stay in front and are merged with this step's
+    int num_collision_events = stream->num_collision_events;
+
+    int total = num_collision_events;
+    for (int t = 0; t < stream->num_thread_buffers; t++) {
+        total += thread_buffers[t].count;
+    }
+    if (total > stream->merged_capacity) {
+        CollisionEvent* grown = (CollisionEvent*)realloc(collision_events, total * sizeof(CollisionEvent));
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate memory for collision events\n");
+            return;
+        }
+        collision_events = grown;
+        stream->collision_events = grown;
+        stream->merged_capacity = total;
+    }
+    for (int t = 0; t < stream->num_thread_buffers; t++) {
+        for (int k = 0; k < thread_buffers[t].count; k++) {
+            collision_events[num_collision_events++] = thread_buffers[t].events[k];
+        }
+        thread_buffers[t].count = 0;
+    }
+
+    // A contact usually spans several substeps and steps; keep one event per pair
+    qsort(collision_events, num_collision_events, sizeof(CollisionEvent), compareEvents);
+    int unique = 0;
+    for (int k = 0; k < num_collision_events; k++) {
+        if (unique > 0 && compareEvents(&collision_events[unique - 1], &collision_events[k]) == 0) {
+            CollisionEvent* kept = &collision_events[unique - 1];
+            kept->penetration = MFMAX(kept->penetration, collision_events[k].penetration);
+            kept->relative_speed = MFMAX(kept->relative_speed, collision_events[k].relative_speed);
+        } else {
+            collision_events[unique++] = collision_events[k];
+        }
+    }
+    stream->num_collision_events = unique;
+}
+
+void moveParticleEvents(PhysicsWorld* world, int from, int to) {
+    EventStream* stream = world->events;
+    if (!stream) return;
+    CollisionEvent* collision_events = stream->collision_events;
+    int kept = 0;
+    for (int k = 0; k < stream->num_collision_events; k++) {
+        CollisionEvent event = collision_events[k];
+        if (event.a == to || event.b == to) continue;
+        int a = event.a == from ? to : event.a;
+        int b = event.b == from ? to : event.b;
+        event.a = a < b ? a : b;
+        event.b = a < b ? b : a;
+        collision_events[kept++] = event;
+    }
+    stream->num_collision_events = kept;
+}
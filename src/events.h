@@ -0,0 +1,70 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+#include "mathc.h"
+#include "physics.h"
+
+typedef struct {
+    int a;
+    int b;
+    mfloat_t penetration;    // Overlap depth when the contact was resolved
+    mfloat_t relative_speed; // Closing speed along the contact normal, units per second
+} CollisionEvent;
+
+// Each thread appends to its own buffer, so recording needs no locks. The
+// padding keeps neighbouring counters off the same cache line.
+typedef struct {
+    CollisionEvent* events;
+    int count;
+    int capacity;
+    char padding[64];
+} EventBuffer;
+
+typedef struct EventStream {
+    // Contacts since the last clearCollisionEvents, one event per particle
+    // pair (a < b) with the largest speed and penetration seen in that time.
+    // Every step adds to them, so a frame that runs several steps sees the
+    // contacts of all of them. Valid until the next step or clear.
+    // removeParticle keeps the indices current: it drops the events of the
+    // removed particle and renames those of the particle moved into its slot.
+    CollisionEvent* collision_events;
+    int num_collision_events;
+
+    // Set while subscribed. Collision detection checks it once per pass and
+    // runs a variant without any event code when it is clear.
+    bool enabled;
+    // Closing displacement per substep above which a contact is recorded
+    mfloat_t threshold;
+
+    // One per thread of the largest team a step can run, sized at the start
+    // of each step
+    EventBuffer* thread_buffers;
+    int num_thread_buffers;
+    int merged_capacity;
+    mfloat_t min_relative_speed;
+    mfloat_t speed_scale;
+} EventStream;
+
+// Starts recording contacts whose closing speed exceeds minRelativeSpeed
+void subscribeCollisionEvents(PhysicsWorld* world, mfloat_t minRelativeSpeed);
+// Stops recording and frees the event buffers
+void unsubscribeCollisionEvents(PhysicsWorld* world);
+
+// Drops the recorded events. Callers read collision_events and clear them
+// once per frame, before the frame's first step.
+void clearCollisionEvents(PhysicsWorld* world);
+
+// Sets the recording threshold for a step of substeps of length subDt
+void beginCollisionEventStep(PhysicsWorld* world, float subDt);
+// Merges the per-thread buffers into collision_events and empties them
+void endCollisionEventStep(PhysicsWorld* world);
+
+// Drops the events of particle to, then renames particle from to to.
+// Called when a particle moves between slots, e.g. by removeParticle.
+void moveParticleEvents(PhysicsWorld* world, int from, int to);
+
+// Appends to the calling thread's buffer; closing is per substep
+void recordCollisionEvent(EventStream* stream, int a, int b, mfloat_t penetration, mfloat_t closing);
+
+#endif
@@ -0,0 +1,76 @@
+#include "layers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocates the world's layers on first use, with every particle in the
+// default layers
+static CollisionLayers* worldLayers(PhysicsWorld* world) {
+    if (!world->layers) {
+        CollisionLayers* layers = (CollisionLayers*)calloc(1, sizeof(CollisionLayers));
+        if (layers) {
+            layers->cell_category = (unsigned int*)calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(unsigned int));
+            layers->cell_mask = (unsigned int*)calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(unsigned int));
+        }
+        if (!layers || !layers->cell_category || !layers->cell_mask) {
+            fprintf(stderr, "Failed to allocate memory for the collision layers\n");
+            if (layers) {
+                free(layers->cell_category);
+                free(layers->cell_mask);
+            }
+            free(layers);
+            return NULL;
+        }
+        world->layers = layers;
+        clearCollisionLayers(world);
+    }
+    return world->layers;
+}
+
+void setCollisionLayers(PhysicsWorld* world, int first, int count, unsigned int category, unsigned int mask) {
+    CollisionLayers* layers = worldLayers(world);
+    if (!layers) return;
+    for (int i = first; i < first + count && i < NUM_PARTICLES; i++) {
+        if (i < 0) continue;
+        layers->category[i] = category;
+        layers->mask[i] = mask;
+    }
+    if (category != LAYER_ALL || mask != LAYER_ALL) layers->enabled = true;
+}
+
+void clearCollisionLayers(PhysicsWorld* world) {
+    CollisionLayers* layers = world->layers;
+    if (!layers) return;
+    for (int i = 0; i < NUM_PARTICLES; i++) {
+        layers->category[i] = LAYER_ALL;
+        layers->mask[i] = LAYER_ALL;
+    }
+    layers->enabled = false;
+}
+
+void cleanupCollisionLayers(PhysicsWorld* world) {
+    CollisionLayers* layers = world->layers;
+    if (!layers) return;
+    free(layers->cell_category);
+    free(layers->cell_mask);
+    layers->cell_category = NULL;
+    layers->cell_mask = NULL;
+    layers->enabled = false;
+}
+
+void updateCellLayers(PhysicsWorld* world) {
+    CollisionLayers* layers = world->layers;
+    const GridCell* grid = world->grid;
+
+    #pragma omp parallel for schedule(static)
+    for (int c = 0; c < GRID_WIDTH * GRID_HEIGHT; c++) {
+        unsigned int category = 0;
+        unsigned int mask = 0;
+        for (int k = 0; k < grid[c].num_particles; k++) {
+            int p_idx = grid[c].particle_indices[k];
+            category |= layers->category[p_idx];
+            mask |= layers->mask[p_idx];
+        }
+        layers->cell_category[c] = category;
+        layers->cell_mask[c] = mask;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include <stdbool.h>
+#include "mathc.h"
+#include "physics.h"
+
+#define LAYER_ALL 0xFFFFFFFFu // Default category and mask: collides with everything
+
+// Collision layers. Every particle belongs to the layers in its category
+// bits and collides only with particles whose category overlaps its mask;
+// both sides must accept the pair. removeParticle carries a particle's
+// layers to its new slot, and initParticleSlot resets them.
+typedef struct CollisionLayers {
+    unsigned int category[NUM_PARTICLES];
+    unsigned int mask[NUM_PARTICLES];
+
+    // Union of the categories and masks of the particles in each grid cell,
+    // GRID_WIDTH * GRID_HEIGHT entries indexed like the grid. A neighbour
+    // cell whose union cannot meet a particle is skipped without touching
+    // its particles.
+    unsigned int* cell_category;
+    unsigned int* cell_mask;
+
+    // Set once a particle leaves the default layers. Collision detection
+    // checks it once per pass.
+    bool enabled;
+} CollisionLayers;
+
+// Puts particles [first, first + count) in the category layers, colliding
+// with the mask layers
+void setCollisionLayers(PhysicsWorld* world, int first, int count, unsigned int category, unsigned int mask);
+// Returns every particle to the default layers
+void clearCollisionLayers(PhysicsWorld* world);
+// Frees the per-cell unions
+void cleanupCollisionLayers(PhysicsWorld* world);
+
+// Recomputes the per-cell unions from the current grid
+void updateCellLayers(PhysicsWorld* world);
+
+static inline bool layersInteract(unsigned int category1, unsigned int mask1, unsigned int category2,
+                                  unsigned int mask2) {
+    return (category1 & mask2) && (category2 & mask1);
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "nbody.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MORTON_BITS 16 // Quadtree depth limit, bits per axis
+#define TASK_DEPTH 3   // Subtrees above this depth are built as parallel tasks
+#define TRAVERSAL_STACK_SIZE (4 * MORTON_BITS + 4)
+
+typedef struct {
+    mfloat_t com_x;
+    mfloat_t com_y;
+    mfloat_t mass;
+    mfloat_t half_size;
+    int first; // Range of the node's bodies in the sorted arrays
+    int count;
+    int child[4]; // -1 where a quadrant is empty; all -1 for leaves
+} QuadNode;
+
+typedef struct BarnesHutTree {
+    // Bodies sorted by Morton code, in SoA form for the direct-sum loops
+    uint32_t* codes;
+    uint32_t* codes_scratch;
+    int* order;
+    int* order_scratch;
+    mfloat_t* body_x;
+    mfloat_t* body_y;
+    int body_capacity;
+
+    // Internal nodes always have at least two children, so 2N nodes suffice
+    QuadNode* nodes;
+    int num_nodes;
+    mfloat_t root_half_size;
+} BarnesHutTree;
+
+static void freeTreeBuffers(BarnesHutTree* tree) {
+    free(tree->codes);
+    free(tree->codes_scratch);
+    free(tree->order);
+    free(tree->order_scratch);
+    free(tree->body_x);
+    free(tree->body_y);
+    free(tree->nodes);
+    tree->codes = tree->codes_scratch = NULL;
+    tree->order = tree->order_scratch = NULL;
+    tree->body_x = tree->body_y = NULL;
+    tree->nodes = NULL;
+    tree->body_capacity = 0;
+}
+
+// Allocates the world's tree on first use and grows it to hold count bodies
+static BarnesHutTree* reserveBodies(PhysicsWorld* world, int count) {
+    if (!world->nbody) {
+        world->nbody = (BarnesHutTree*)calloc(1, sizeof(BarnesHutTree));
+        if (!world->nbody) {
+            fprintf(stderr, "Failed to allocate memory for the Barnes-Hut tree\n");
+            return NULL;
+        }
+    }
+    BarnesHutTree* tree = world->nbody;
+    if (count <= tree->body_capacity) return tree;
+    freeTreeBuffers(tree);
+    tree->codes = (uint32_t*)malloc(count * sizeof(uint32_t));
+    tree->codes_scratch = (uint32_t*)malloc(count * sizeof(uint32_t));
+    tree->order = (int*)malloc(count * sizeof(int));
+    tree->order_scratch = (int*)malloc(count * sizeof(int));
+    tree->body_x = (mfloat_t*)malloc(count * sizeof(mfloat_t));
+    tree->body_y = (mfloat_t*)malloc(count * sizeof(mfloat_t));
+    tree->nodes = (QuadNode*)malloc((2 * count + 1) * sizeof(QuadNode));
+    if (!tree->codes || !tree->codes_scratch || !tree->order || !tree->order_scratch
+        || !tree->body_x || !tree->body_y || !tree->nodes) {
+        fprintf(stderr, "Failed to allocate memory for the Barnes-Hut tree\n");
+        freeTreeBuffers(tree);
+        return NULL;
+    }
+    tree->body_capacity = count;
+    return tree;
+}
+
+void cleanupMutualGravity(PhysicsWorld* world) {
+    if (!world->nbody) return;
+    freeTreeBuffers(world->nbody);
+}
+
+// Spreads the low 16 bits of v so that a zero bit sits between each
+static inline uint32_t spreadBits(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static inline int quadrant(uint32_t code, int level) {
+    return (int)((code >> (2 * (MORTON_BITS - 1 - level))) & 3);
+}
+
+// LSD radix sort of (code, index) pairs, 8 bits per pass
+static void sortByCode(BarnesHutTree* tree, int count) {
+    uint32_t* codes = tree->codes;
+    uint32_t* codes_scratch = tree->codes_scratch;
+    int* order = tree->order;
+    int* order_scratch = tree->order_scratch;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int histogram[257] = {0};
+        for (int i = 0; i < count; i++) {
+            histogram[((codes[i] >> shift) & 0xff) + 1]++;
+        }
+        for (int b = 0; b < 256; b++) {
+            histogram[b + 1] += histogram[b];
+        }
+        for (int i = 0; i < count; i++) {
+            int dst = histogram[(codes[i] >> shift) & 0xff]++;
+            codes_scratch[dst] = codes[i];
+            order_scratch[dst] = order[i];
+        }
+        uint32_t* swap_codes = codes;
+        codes = codes_scratch;
+        codes_scratch = swap_codes;
+        int* swap_order = order;
+        order = order_scratch;
+        order_scratch = swap_order;
+    }
+    tree->codes = codes;
+    tree->codes_scratch = codes_scratch;
+    tree->order = order;
+    tree->order_scratch = order_scratch;
+}
+
+static int allocNode(BarnesHutTree* tree) {
+    int node;
+    #pragma omp atomic capture
+    node = tree->num_nodes++;
+    return node;
+}
+
+static void buildNode(BarnesHutTree* tree, int node, int first, int count, int level) {
+    const uint32_t* codes = tree->codes;
+    QuadNode* q = &tree->nodes[node];
+    q->first = first;
+    q->count = count;
+    q->child[0] = q->child[1] = q->child[2] = q->child[3] = -1;
+
+    // Skip levels where every body falls in the same quadrant, so internal
+    // nodes always split. Codes are sorted and share the prefix above level,
+    // so comparing the first and last body is enough.
+    while (count > NBODY_LEAF_SIZE && level < MORTON_BITS
+           && quadrant(codes[first], level) == quadrant(codes[first + count - 1], level)) {
+        level++;
+    }
+    q->half_size = tree->root_half_size / (mfloat_t)(1 << level);
+
+    if (count <= NBODY_LEAF_SIZE || level >= MORTON_BITS) {
+        mfloat_t sum_x = 0.0f;
+        mfloat_t sum_y = 0.0f;
+        for (int k = first; k < first + count; k++) {
+            sum_x += tree->body_x[k];
+            sum_y += tree->body_y[k];
+        }
+        q->mass = (mfloat_t)count;
+        q->com_x = sum_x / count;
+        q->com_y = sum_y / count;
+        return;
+    }
+
+    int start = first;
+    for (int quad = 0; quad < 4; quad++) {
+        int end = start;
+        while (end < first + count && quadrant(codes[end], level) == quad) end++;
+        if (end > start) {
+            int child = allocNode(tree);
+            q->child[quad] = child;
+            if (level < TASK_DEPTH) {
+                #pragma omp task firstprivate(child, start, end, level)
+                buildNode(tree, child, start, end - start, level + 1);
+            } else {
+                buildNode(tree, child, start, end - start, level + 1);
+            }
+        }
+        start = end;
+    }
+    #pragma omp taskwait
+
+    mfloat_t mass = 0.0f;
+    mfloat_t sum_x = 0.0f;
+    mfloat_t sum_y = 0.0f;
+    for (int quad = 0; quad < 4; quad++) {
+        if (q->child[quad] < 0) continue;
+        const QuadNode* c = &tree->nodes[q->child[quad]];
+        mass += c->mass;
+        sum_x += c->com_x * c->mass;
+        sum_y += c->com_y * c->mass;
+    }
+    q->mass = mass;
+    q->com_x = sum_x / mass;
+    q->com_y = sum_y / mass;
+}
+
+static void buildTree(BarnesHutTree* tree, const Particle* particles, int activeParticles) {
+    mfloat_t min_x = particles[0].curr_position[0];
+    mfloat_t max_x = min_x;
+    mfloat_t min_y = particles[0].curr_position[1];
+    mfloat_t max_y = min_y;
+    #pragma omp parallel for reduction(min : min_x, min_y) reduction(max : max_x, max_y)
+    for (int i = 0; i < activeParticles; i++) {
+        min_x = MFMIN(min_x, particles[i].curr_position[0]);
+        max_x = MFMAX(max_x, particles[i].curr_position[0]);
+        min_y = MFMIN(min_y, particles[i].curr_position[1]);
+        max_y = MFMAX(max_y, particles[i].curr_position[1]);
+    }
+    mfloat_t side = MFMAX(max_x - min_x, max_y - min_y) * 1.0001f + MFLT_EPSILON;
+    mfloat_t scale = (mfloat_t)((1 << MORTON_BITS) - 1) / side;
+    tree->root_half_size = 0.5f * side;
+
+    uint32_t* codes = tree->codes;
+    int* order = tree->order;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < activeParticles; i++) {
+        uint32_t qx = (uint32_t)((particles[i].curr_position[0] - min_x) * scale);
+        uint32_t qy = (uint32_t)((particles[i].curr_position[1] - min_y) * scale);
+        codes[i] = (spreadBits(qy) << 1) | spreadBits(qx);
+        order[i] = i;
+    }
+    sortByCode(tree, activeParticles);
+
+    order = tree->order;
+    mfloat_t* body_x = tree->body_x;
+    mfloat_t* body_y = tree->body_y;
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < activeParticles; k++) {
+        body_x[k] = particles[order[k]].curr_position[0];
+        body_y[k] = particles[order[k]].curr_position[1];
+    }
+
+    tree->num_nodes = 1;
+    #pragma omp parallel
+    #pragma omp single
+    buildNode(tree, 0, 0, activeParticles, 0);
+}
+
+void applyMutualGravity(PhysicsWorld* world) {
+    const int activeParticles = world->active_particles;
+    if (activeParticles < 2) return;
+    BarnesHutTree* tree = reserveBodies(world, activeParticles);
+    if (!tree) return;
+    Particle* particles = world->particles;
+    buildTree(tree, particles, activeParticles);
+
+    const QuadNode* nodes = tree->nodes;
+    const int* order = tree->order;
+    const mfloat_t* body_x = tree->body_x;
+    const mfloat_t* body_y = tree->body_y;
+    const mfloat_t theta_sq = world->nbody_theta * world->nbody_theta;
+    const mfloat_t softening_sq = NBODY_SOFTENING * NBODY_SOFTENING;
+
+    // Walk bodies in Morton order so neighbouring iterations touch the
+    // same nodes
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int k = 0; k < activeParticles; k++) {
+        const mfloat_t px = body_x[k];
+        const mfloat_t py = body_y[k];
+        mfloat_t ax = 0.0f;
+        mfloat_t ay = 0.0f;
+
+        int stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const QuadNode* q = &nodes[stack[--top]];
+            mfloat_t dx = q->com_x - px;
+            mfloat_t dy = q->com_y - py;
+            mfloat_t dist_sq = dx * dx + dy * dy;
+            mfloat_t size = 2.0f * q->half_size;
+            bool leaf = q->child[0] < 0 && q->child[1] < 0 && q->child[2] < 0 && q->child[3] < 0;
+
+            if (!leaf && size * size < theta_sq * dist_sq) {
+                // Far enough away: the node acts as one body at its centre of mass
+                mfloat_t r_sq = dist_sq + softening_sq;
+                mfloat_t inv = q->mass / (r_sq * MSQRT(r_sq));
+                ax += dx * inv;
+                ay += dy * inv;
+            } else if (leaf) {
+                // Direct sum over the leaf bodies; the body itself adds zero
+                const int first = q->first;
+                const int end = q->first + q->count;
+                #pragma omp simd reduction(+ : ax, ay)
+                for (int b = first; b < end; b++) {
+                    mfloat_t bx = body_x[b] - px;
+                    mfloat_t by = body_y[b] - py;
+                    mfloat_t r_sq = bx * bx + by * by + softening_sq;
+                    mfloat_t inv = 1.0f / (r_sq * MSQRT(r_sq));
+                    ax += bx * inv;
+                    ay += by * inv;
+                }
+            } else {
+                for (int quad = 0; quad < 4; quad++) {
+                    if (q->child[quad] >= 0 && top < TRAVERSAL_STACK_SIZE) stack[top++] = q->child[quad];
+                }
+            }
+        }
+
+        Particle* p = &particles[order[k]];
+        p->acceleration[0] += NBODY_G * ax;
+        p->acceleration[1] += NBODY_G * ay;
+    }
+}
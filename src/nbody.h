@@ -0,0 +1,20 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define NBODY_G 2000.0f         // Gravitational constant in simulation units (unit particle mass)
+#define NBODY_SOFTENING 4.0f    // Plummer softening length, keeps close encounters finite
+#define NBODY_THETA 0.6f        // Default Barnes-Hut opening angle
+#define NBODY_LEAF_SIZE 8       // Bodies per leaf, evaluated by direct summation
+
+// Builds a Barnes-Hut quadtree over the active particles and adds the
+// mutual gravitational acceleration of every particle to its acceleration.
+// world->nbody_theta is the opening angle; smaller is more accurate.
+void applyMutualGravity(PhysicsWorld* world);
+
+// Frees the tree and scratch buffers
+void cleanupMutualGravity(PhysicsWorld* world);
+
+#endif
@@ -0,0 +1,281 @@
+#include "pairs.h"
+#include "layers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void refreshContactTable(PairTable* pairs) {
+    for (int a = 0; a < MAX_SPECIES; a++) {
+        const Material* ma = &pairs->materials[a];
+        pairs->inverse_mass[a] = 1.0f / ma->mass;
+        for (int b = 0; b < MAX_SPECIES; b++) {
+            const Material* mb = &pairs->materials[b];
+            ContactMaterial* contact = &pairs->contact_table[a][b];
+            contact->share = mb->mass / (ma->mass + mb->mass);
+            contact->restitution = MFMAX(ma->restitution, mb->restitution);
+            contact->friction = MSQRT(ma->friction * mb->friction);
+        }
+    }
+}
+
+static void resetMaterials(PairTable* pairs) {
+    for (int s = 0; s < MAX_SPECIES; s++) {
+        pairs->materials[s].mass = 1.0f;
+        pairs->materials[s].restitution = CONTAINER_RESPONSE;
+        pairs->materials[s].friction = 0.0f;
+    }
+    pairs->materials_enabled = false;
+    refreshContactTable(pairs);
+}
+
+// Allocates the world's pair table on first use
+static PairTable* worldPairs(PhysicsWorld* world) {
+    if (!world->pairs) {
+        world->pairs = (PairTable*)calloc(1, sizeof(PairTable));
+        if (!world->pairs) {
+            fprintf(stderr, "Failed to allocate memory for the pair table\n");
+            return NULL;
+        }
+        resetMaterials(world->pairs);
+    }
+    return world->pairs;
+}
+
+void setParticleSpecies(PhysicsWorld* world, int first, int count, int species) {
+    if (species < 0 || species >= MAX_SPECIES) return;
+    PairTable* pairs = worldPairs(world);
+    if (!pairs) return;
+    for (int i = first; i < first + count && i < NUM_PARTICLES; i++) {
+        if (i >= 0) pairs->particle_species[i] = (unsigned char)species;
+    }
+}
+
+static void refreshInteractionSummary(PairTable* pairs) {
+    pairs->num_interactions = 0;
+    pairs->max_cutoff = 0.0f;
+    for (int a = 0; a < MAX_SPECIES; a++) {
+        for (int b = 0; b < MAX_SPECIES; b++) {
+            if (pairs->pair_table[a][b].kind == PAIR_NONE) continue;
+            pairs->num_interactions++;
+            pairs->max_cutoff = MFMAX(pairs->max_cutoff, pairs->pair_table[a][b].cutoff);
+        }
+    }
+}
+
+void setPairInteraction(PhysicsWorld* world, int a, int b, PairParams params) {
+    if (a < 0 || b < 0 || a >= MAX_SPECIES || b >= MAX_SPECIES) return;
+    PairTable* pairs = worldPairs(world);
+    if (!pairs) return;
+    pairs->pair_table[a][b] = params;
+    pairs->pair_table[b][a] = params;
+    refreshInteractionSummary(pairs);
+}
+
+void clearPairInteractions(PhysicsWorld* world) {
+    PairTable* pairs = world->pairs;
+    if (!pairs) return;
+    for (int a = 0; a < MAX_SPECIES; a++) {
+        for (int b = 0; b < MAX_SPECIES; b++) {
+            pairs->pair_table[a][b].kind = PAIR_NONE;
+        }
+    }
+    refreshInteractionSummary(pairs);
+}
+
+int setSpeciesMaterial(PhysicsWorld* world, int species, Material material) {
+    if (species < 0 || species >= MAX_SPECIES) {
+        printf("Error: species %d is out of range (max %d)\n", species, MAX_SPECIES - 1);
+        return -1;
+    }
+    if (material.mass <= 0.0f || material.restitution < 0.0f || material.restitution > 1.0f || material.friction < 0.0f) {
+        printf("Error: species %d needs a positive mass, restitution in [0, 1] and non-negative friction\n", species);
+        return -1;
+    }
+    PairTable* pairs = worldPairs(world);
+    if (!pairs) return -1;
+    pairs->materials[species] = material;
+    pairs->materials_enabled = true;
+    refreshContactTable(pairs);
+    return 0;
+}
+
+void clearSpeciesMaterials(PhysicsWorld* world) {
+    if (world->pairs) resetMaterials(world->pairs);
+}
+
+void cleanupPairForces(PhysicsWorld* world) {
+    PairTable* pairs = world->pairs;
+    if (!pairs) return;
+    free(pairs->pair_i);
+    free(pairs->pair_j);
+    free(pairs->pair_fx);
+    free(pairs->pair_fy);
+    pairs->pair_i = NULL;
+    pairs->pair_j = NULL;
+    pairs->pair_fx = NULL;
+    pairs->pair_fy = NULL;
+    pairs->pair_capacity = 0;
+}
+
+static int reservePairs(PairTable* pairs, int count) {
+    if (count <= pairs->pair_capacity) return 1;
+    int capacity = count * 2;
+    int* grown_i = (int*)realloc(pairs->pair_i, capacity * sizeof(int));
+    if (grown_i) pairs->pair_i = grown_i;
+    int* grown_j = (int*)realloc(pairs->pair_j, capacity * sizeof(int));
+    if (grown_j) pairs->pair_j = grown_j;
+    mfloat_t* grown_fx = (mfloat_t*)realloc(pairs->pair_fx, capacity * sizeof(mfloat_t));
+    if (grown_fx) pairs->pair_fx = grown_fx;
+    mfloat_t* grown_fy = (mfloat_t*)realloc(pairs->pair_fy, capacity * sizeof(mfloat_t));
+    if (grown_fy) pairs->pair_fy = grown_fy;
+    if (!grown_i || !grown_j || !grown_fx || !grown_fy) {
+        fprintf(stderr, "Failed to allocate memory for the pair stream\n");
+        return 0;
+    }
+    pairs->pair_capacity = capacity;
+    return 1;
+}
+
+// Returns the force law for (i, j) or PAIR_NONE if the pair is out of range
+// or its collision layers exclude each other. layers is NULL when no
+// particle uses them.
+static inline PairKind pairKind(const PairTable* pairs, const CollisionLayers* layers, const Particle* particles,
+                                const mfloat_t* wrap, int i, int j) {
+    const PairParams* params = &pairs->pair_table[pairs->particle_species[i]][pairs->particle_species[j]];
+    if (params->kind == PAIR_NONE) return PAIR_NONE;
+    if (layers && !layersInteract(layers->category[i], layers->mask[i], layers->category[j], layers->mask[j])) {
+        return PAIR_NONE;
+    }
+    mfloat_t dx = wrapSeparation(particles[i].curr_position[0] - particles[j].curr_position[0], wrap[0]);
+    mfloat_t dy = wrapSeparation(particles[i].curr_position[1] - particles[j].curr_position[1], wrap[1]);
+    return (dx * dx + dy * dy < params->cutoff * params->cutoff) ? params->kind : PAIR_NONE;
+}
+
+static int buildPairStream(PhysicsWorld* world, PairTable* pairs, const mfloat_t* wrap) {
+    if (buildNeighborLists(world, pairs->max_cutoff) < 0) return 0;
+    const int activeParticles = world->active_particles;
+    const Particle* particles = world->particles;
+    const int* neighbor_offsets = world->neighbor_offsets;
+    const int* neighbor_indices = world->neighbor_indices;
+    int* kind_offsets = pairs->kind_offsets;
+    const CollisionLayers* layers = (world->layers && world->layers->enabled) ? world->layers : NULL;
+
+    int counts[PAIR_KIND_COUNT] = {0};
+    for (int i = 0; i < activeParticles; i++) {
+        for (int n = neighbor_offsets[i]; n < neighbor_offsets[i + 1]; n++) {
+            int j = neighbor_indices[n];
+            if (j <= i) continue;
+            counts[pairKind(pairs, layers, particles, wrap, i, j)]++;
+        }
+    }
+
+    int next[PAIR_KIND_COUNT];
+    kind_offsets[PAIR_NONE] = 0;
+    kind_offsets[PAIR_NONE + 1] = 0;
+    next[PAIR_NONE] = 0;
+    for (int k = PAIR_NONE + 1; k < PAIR_KIND_COUNT; k++) {
+        next[k] = kind_offsets[k];
+        kind_offsets[k + 1] = kind_offsets[k] + counts[k];
+    }
+    if (!reservePairs(pairs, kind_offsets[PAIR_KIND_COUNT] + 1)) return 0;
+
+    for (int i = 0; i < activeParticles; i++) {
+        for (int n = neighbor_offsets[i]; n < neighbor_offsets[i + 1]; n++) {
+            int j = neighbor_indices[n];
+            if (j <= i) continue;
+            PairKind kind = pairKind(pairs, layers, particles, wrap, i, j);
+            if (kind == PAIR_NONE) continue;
+            int slot = next[kind]++;
+            pairs->pair_i[slot] = i;
+            pairs->pair_j[slot] = j;
+        }
+    }
+    return 1;
+}
+
+// Generates one batched loop per force law. FORCE is the signed force
+// magnitude along the axis from b to a (positive pushes apart) and can use
+// r, contact (sum of radii), vn (separating normal speed) and params.
+#define DEFINE_PAIR_KERNEL(name, FORCE)                                                   \
+    static void name(PairTable* pairs, const Particle* particles, const mfloat_t* wrap, int begin, int end, float dt) { \
+        const int* pair_i = pairs->pair_i;                                                \
+        const int* pair_j = pairs->pair_j;                                                \
+        mfloat_t* pair_fx = pairs->pair_fx;                                               \
+        mfloat_t* pair_fy = pairs->pair_fy;                                               \
+        _Pragma("omp parallel for schedule(static)")                                      \
+        for (int k = begin; k < end; k++) {                                               \
+            const Particle* a = &particles[pair_i[k]];                                    \
+            const Particle* b = &particles[pair_j[k]];                                    \
+            const PairParams* params = &pairs->pair_table[pairs->particle_species[pair_i[k]]][pairs->particle_species[pair_j[k]]]; \
+            mfloat_t dx = wrapSeparation(a->curr_position[0] - b->curr_position[0], wrap[0]); \
+            mfloat_t dy = wrapSeparation(a->curr_position[1] - b->curr_position[1], wrap[1]); \
+            mfloat_t r = MSQRT(dx * dx + dy * dy) + MFLT_EPSILON;                         \
+            mfloat_t nx = dx / r;                                                         \
+            mfloat_t ny = dy / r;                                                         \
+            mfloat_t contact = a->radius + b->radius;                                     \
+            mfloat_t vn = (((a->curr_position[0] - a->old_position[0]) - (b->curr_position[0] - b->old_position[0])) * nx \
+                         + ((a->curr_position[1] - a->old_position[1]) - (b->curr_position[1] - b->old_position[1])) * ny) / dt; \
+            (void)contact;                                                                \
+            (void)vn;                                                                     \
+            mfloat_t force = (FORCE);                                                     \
+            pair_fx[k] = force * nx;                                                      \
+            pair_fy[k] = force * ny;                                                      \
+        }                                                                                 \
+    }
+
+DEFINE_PAIR_KERNEL(cohesionKernel,
+    -params->strength * MFMIN(1.0f, MFMAX(0.0f, 1.0f - (r - contact) / (params->cutoff - contact + MFLT_EPSILON))))
+
+DEFINE_PAIR_KERNEL(springDashpotKernel,
+    params->strength * (contact - r) - params->damping * vn)
+
+// 12-6 Lennard-Jones force, with r clamped so deep overlaps stay finite
+static inline mfloat_t lennardJonesForce(mfloat_t r, mfloat_t depth, mfloat_t sigma) {
+    mfloat_t rc = MFMAX(r, 0.8f * sigma);
+    mfloat_t s2 = (sigma * sigma) / (rc * rc);
+    mfloat_t s6 = s2 * s2 * s2;
+    return 24.0f * depth / rc * (2.0f * s6 * s6 - s6);
+}
+
+DEFINE_PAIR_KERNEL(lennardJonesKernel,
+    lennardJonesForce(r, params->strength, params->sigma))
+
+static void (*const pair_kernels[PAIR_KIND_COUNT])(PairTable* pairs, const Particle* particles, const mfloat_t* wrap, int begin,
+                                                    int end, float dt) = {
+    [PAIR_NONE] = NULL,
+    [PAIR_COHESION] = cohesionKernel,
+    [PAIR_SPRING_DASHPOT] = springDashpotKernel,
+    [PAIR_LENNARD_JONES] = lennardJonesKernel
+};
+
+void applyPairForces(PhysicsWorld* world, float dt) {
+    PairTable* pairs = world->pairs;
+    if (!pairs || pairs->num_interactions == 0 || world->active_particles == 0) return;
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+    if (!buildPairStream(world, pairs, wrap)) return;
+
+    Particle* particles = world->particles;
+    const int* kind_offsets = pairs->kind_offsets;
+    for (int k = PAIR_NONE + 1; k < PAIR_KIND_COUNT; k++) {
+        if (kind_offsets[k + 1] > kind_offsets[k]) {
+            pair_kernels[k](pairs, particles, wrap, kind_offsets[k], kind_offsets[k + 1], dt);
+        }
+    }
+
+    const int* pair_i = pairs->pair_i;
+    const int* pair_j = pairs->pair_j;
+    const mfloat_t* pair_fx = pairs->pair_fx;
+    const mfloat_t* pair_fy = pairs->pair_fy;
+
+    const unsigned char* species = pairs->particle_species;
+    const mfloat_t* inverse_mass = pairs->inverse_mass;
+
+    // Scatter is sequential because a particle appears in many pairs
+    for (int k = kind_offsets[PAIR_NONE + 1]; k < kind_offsets[PAIR_KIND_COUNT]; k++) {
+        mfloat_t inv_i = inverse_mass[species[pair_i[k]]];
+        mfloat_t inv_j = inverse_mass[species[pair_j[k]]];
+        particles[pair_i[k]].acceleration[0] += pair_fx[k] * inv_i;
+        particles[pair_i[k]].acceleration[1] += pair_fy[k] * inv_i;
+        particles[pair_j[k]].acceleration[0] -= pair_fx[k] * inv_j;
+        particles[pair_j[k]].acceleration[1] -= pair_fy[k] * inv_j;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef PAIRS_H
+#define PAIRS_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_SPECIES 8
+
+// Short-range pair force laws. The positional repulsion in fixCollisions
+// always runs; these add forces on top of it for configured species pairs.
+typedef enum {
+    PAIR_NONE = 0,
+    PAIR_COHESION,       // Constant pull that fades to zero at the cutoff
+    PAIR_SPRING_DASHPOT, // Linear spring to the contact distance plus normal damping
+    PAIR_LENNARD_JONES,  // 12-6 potential with well depth strength and size sigma
+    PAIR_KIND_COUNT
+} PairKind;
+
+typedef struct {
+    PairKind kind;
+    mfloat_t cutoff;   // Centre distance beyond which the pair does not interact
+    mfloat_t strength; // Cohesion pull, spring stiffness or LJ well depth
+    mfloat_t damping;  // Dashpot coefficient (spring-dashpot only)
+    mfloat_t sigma;    // LJ zero-crossing distance (Lennard-Jones only)
+} PairParams;
+
+// Bulk properties of a species
+typedef struct {
+    mfloat_t mass;
+    mfloat_t restitution; // Share of the closing speed returned by a contact or a wall
+    mfloat_t friction;    // Coulomb coefficient for sliding contacts
+} Material;
+
+// Contact response for an ordered species pair, precomputed from the two
+// materials so the contact kernel does a single lookup
+typedef struct {
+    mfloat_t share;       // First particle's share of the correction, m_b / (m_a + m_b)
+    mfloat_t restitution; // The larger of the two
+    mfloat_t friction;    // Geometric mean of the two
+} ContactMaterial;
+
+typedef struct PairTable {
+    unsigned char particle_species[NUM_PARTICLES];
+    PairParams pair_table[MAX_SPECIES][MAX_SPECIES];
+    int num_interactions;
+    mfloat_t max_cutoff;
+
+    // Material response, off until a species gets a material. Species
+    // without one have unit mass, CONTAINER_RESPONSE restitution and no
+    // friction. The contact table is 8 x 8 x 12 bytes and stays in L1.
+    Material materials[MAX_SPECIES];
+    ContactMaterial contact_table[MAX_SPECIES][MAX_SPECIES];
+    mfloat_t inverse_mass[MAX_SPECIES];
+    bool materials_enabled;
+
+    // Pair stream, bucketed so that pairs using force law k occupy
+    // [kind_offsets[k], kind_offsets[k + 1])
+    int* pair_i;
+    int* pair_j;
+    mfloat_t* pair_fx;
+    mfloat_t* pair_fy;
+    int pair_capacity;
+    int kind_offsets[PAIR_KIND_COUNT + 1];
+} PairTable;
+
+void setParticleSpecies(PhysicsWorld* world, int first, int count, int species);
+
+// Sets the interaction between species a and b (symmetric)
+void setPairInteraction(PhysicsWorld* world, int a, int b, PairParams params);
+void clearPairInteractions(PhysicsWorld* world);
+
+// Gives species a material and switches contacts and walls to material
+// response: mass-weighted position correction, restitution and Coulomb
+// friction. Pair forces are divided by the species mass. Returns -1 if the
+// material is out of range.
+int setSpeciesMaterial(PhysicsWorld* world, int species, Material material);
+// Returns every species to the default material and turns material
+// response off
+void clearSpeciesMaterials(PhysicsWorld* world);
+
+// Gathers every interacting pair from the grid into a pair stream, buckets
+// the stream by force law and runs one specialized loop per law. Returns
+// immediately when no interaction is configured, so pure repulsion pays
+// nothing. dt is the substep length, used to recover velocities. Pairs
+// whose collision layers exclude each other exert no force, as they make
+// no contact.
+void applyPairForces(PhysicsWorld* world, float dt);
+// Frees the pair stream buffers
+void cleanupPairForces(PhysicsWorld* world);
+
+#endif
@@ -1,144 +1,1009 @@
 #include "physics.h"
+#include "sdf.h"
+#include "events.h"
+#include "constraints.h"
+#include "softbody.h"
+#include "rigidbody.h"
+#include "colliders.h"
+#include "sph.h"
+#include "pairs.h"
+#include "nbody.h"
+#include "pm.h"
+#include "tools.h"
+#include "tiles.h"
+#include "layers.h"
 #include <stdlib.h>
 #include <stdio.h>
 
-Particle particles[NUM_PARTICLES];
-static GridCell grid[GRID_WIDTH][GRID_HEIGHT];
+PhysicsWorld* createPhysicsWorld(void) {
+    PhysicsWorld* world = (PhysicsWorld*)calloc(1, sizeof(PhysicsWorld));
+    if (!world) {
+        fprintf(stderr, "Failed to allocate memory for physics world\n");
+        return NULL;
+    }
+    world->grid = (GridCell*)malloc(GRID_WIDTH * GRID_HEIGHT * sizeof(GridCell));
+    if (!world->grid) {
+        fprintf(stderr, "Failed to allocate memory for collision grid\n");
+        free(world);
+        return NULL;
+    }
+    for (int i = 0; i < GRID_WIDTH * GRID_HEIGHT; i++) {
+        world->grid[i].num_particles = 0;
+    }
+
+    world->container = 0;
+    world->container_pos[0] = WINDOW_WIDTH / 2;
+    world->container_pos[1] = WINDOW_HEIGHT / 2;
+    world->gravity = GRAVITY;
+    world->collision_response = COLLISION_RESPONSE;
+    world->container_response = CONTAINER_RESPONSE;
+    world->gravity_mode = GRAVITY_UNIFORM;
+    world->mesh_boundary = PM_ISOLATED;
+    world->nbody_theta = NBODY_THETA;
+    world->substep_cfl = 0.5f;
+    for (int wall = 0; wall < NUM_WALLS; wall++) {
+        world->wall_temperature[wall] = AMBIENT_TEMPERATURE;
+    }
+    return world;
+}
+
+void destroyPhysicsWorld(PhysicsWorld* world) {
+    if (!world) return;
+    clearStaticColliders(world);
+    cleanupMutualGravity(world);
+    cleanupPairForces(world);
+    unsubscribeCollisionEvents(world);
+    cleanupTiles(world);
+    cleanupCollisionLayers(world);
+    free(world->links);
+    free(world->soft_bodies);
+    free(world->rigid_clusters);
+    free(world->colliders);
+    free(world->sdf);
+    free(world->sph);
+    free(world->pairs);
+    free(world->nbody);
+    free(world->mesh);
+    free(world->events);
+    free(world->tools);
+    free(world->tiles);
+    free(world->layers);
+    free(world->neighbor_indices);
+    free(world->grid);
+    free(world);
+}
+
+void stepPhysicsWorld(PhysicsWorld* world, float dt, int substeps) {
+    float sub_dt = dt / substeps;
+    if (world->block_timesteps) {
+        assignTimeLevels(world, world->substep_cfl * PARTICLE_RADIUS);
+    } else {
+        clearTimeLevels(world);
+    }
+    beginCollisionEventStep(world, sub_dt);
+    for (int i = 0; i < substeps; i++) {
+        beginTimeBlockSubstep(world, i);
+        if (world->gravity_mode == GRAVITY_BARNES_HUT) {
+            applyMutualGravity(world);
+        } else if (world->gravity_mode == GRAVITY_PARTICLE_MESH) {
+            applyMeshGravity(world, (PmBoundary)world->mesh_boundary);
+        } else {
+            applyGravity(world);
+        }
+        applySph(world, sub_dt);
+        applyPairForces(world, sub_dt);
+        applyContainerConstraints(world);
+        applyStaticColliders(world);
+        detectCollisions(world);
+        solveLinks(world);
+        solveSoftBodies(world);
+        solveRigidClusters(world);
+        applyDrag(world);
+        updateParticlePositions(world, sub_dt);
+    }
+    endCollisionEventStep(world);
+}
+
+void initParticleSlot(PhysicsWorld* world, int idx) {
+    world->particle_level[idx] = 0;
+    if (world->pairs) world->pairs->particle_species[idx] = 0;
+    if (world->sph) setParticleFluid(world, idx, 1, false);
+    if (world->layers) {
+        world->layers->category[idx] = LAYER_ALL;
+        world->layers->mask[idx] = LAYER_ALL;
+    }
+    if (world->rigid_clusters) vec2_zero(world->rigid_clusters->rest_offset[idx]);
+    if (world->tiles) world->tiles->refilled[idx] = true;
+}
 
-void updateParticlePositions(int activeParticles, float dt) {
-    for (int i = 0; i < activeParticles; i++) {
-        Particle *p = &(particles[i]);
+bool isParticleConstrained(const PhysicsWorld* world, int idx) {
+    return world->constraint_refs[idx] > 0;
+}
+
+int removeParticle(PhysicsWorld* world, int idx) {
+    if (idx < 0 || idx >= world->active_particles) return -1;
+    if (isParticleConstrained(world, idx) || isParticleConstrained(world, world->active_particles - 1)) return -1;
+    int last = --world->active_particles;
+    if (idx != last) {
+        world->particles[idx] = world->particles[last];
+        world->particle_level[idx] = world->particle_level[last];
+        if (world->pairs) world->pairs->particle_species[idx] = world->pairs->particle_species[last];
+        if (world->sph) setParticleFluid(world, idx, 1, world->sph->particle_fluid[last]);
+        if (world->layers) {
+            world->layers->category[idx] = world->layers->category[last];
+            world->layers->mask[idx] = world->layers->mask[last];
+        }
+        if (world->rigid_clusters) {
+            vec2_assign(world->rigid_clusters->rest_offset[idx], world->rigid_clusters->rest_offset[last]);
+        }
+        if (world->tiles) {
+            TileMap* tiles = world->tiles;
+            vec2_assign(tiles->last_position[idx], tiles->last_position[last]);
+            tiles->refilled[idx] = tiles->refilled[last] || last >= tiles->last_active;
+        }
+    }
+    initParticleSlot(world, last);
+    moveDraggedParticle(world, last, idx);
+    moveParticleEvents(world, last, idx);
+    return 0;
+}
+
+void getParticleTraits(const PhysicsWorld* world, int idx, ParticleTraits* traits) {
+    traits->species = world->pairs ? world->pairs->particle_species[idx] : 0;
+    traits->fluid = world->sph ? world->sph->particle_fluid[idx] : 0;
+    traits->category = world->layers ? world->layers->category[idx] : LAYER_ALL;
+    traits->mask = world->layers ? world->layers->mask[idx] : LAYER_ALL;
+}
+
+void setParticleTraits(PhysicsWorld* world, int idx, const ParticleTraits* traits) {
+    initParticleSlot(world, idx);
+    // Subsystems are only set up for particles that leave the defaults
+    if (traits->species != 0) setParticleSpecies(world, idx, 1, traits->species);
+    if (traits->fluid) setParticleFluid(world, idx, 1, true);
+    if (traits->category != LAYER_ALL || traits->mask != LAYER_ALL) {
+        setCollisionLayers(world, idx, 1, traits->category, traits->mask);
+    }
+}
+
+static inline GridCell* gridAt(const PhysicsWorld* world, int cell_x, int cell_y) {
+    return &world->grid[cell_x * GRID_HEIGHT + cell_y];
+}
+
+static inline int isLevelDue(int level, int substep) {
+    // A level-L particle integrates on the last substep of each 2^L block
+    return ((substep + 1) & ((1 << level) - 1)) == 0;
+}
+
+static inline void regionOf(const mfloat_t* position, int* rx, int* ry) {
+    int x = (int)MFLOOR(position[0] / TIME_REGION_SIZE);
+    int y = (int)MFLOOR(position[1] / TIME_REGION_SIZE);
+    *rx = x < 0 ? 0 : (x >= TIME_REGION_WIDTH ? TIME_REGION_WIDTH - 1 : x);
+    *ry = y < 0 ? 0 : (y >= TIME_REGION_HEIGHT ? TIME_REGION_HEIGHT - 1 : y);
+}
+
+void updateParticlePositions(PhysicsWorld* world, float dt) {
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle *p = &(world->particles[i]);
+        mfloat_t step_dt = dt;
+        if (world->time_levels_enabled) {
+            int level = world->particle_level[i];
+            if (!isLevelDue(level, world->current_substep)) continue;
+            // Acceleration accumulated over the block is averaged
+            step_dt = dt * (1 << level);
+            vec2_divide_f(p->acceleration, p->acceleration, (mfloat_t)(1 << level));
+        }
         mfloat_t velocity[VEC2_SIZE];
         vec2_subtract(velocity, p->curr_position, p->old_position);
         vec2_assign(p->old_position, p->curr_position);
-        vec2_multiply_f(p->acceleration, p->acceleration, dt * dt);
+        vec2_multiply_f(p->acceleration, p->acceleration, step_dt * step_dt);
         vec2_add(p->curr_position, p->curr_position, velocity);
         vec2_add(p->curr_position, p->curr_position, p->acceleration);
         vec2_zero(p->acceleration);
     }
 }
 
-void applyGravity(int activeParticles) {
-    for (int i = 0; i < activeParticles; i++) {
-        particles[i].acceleration[1] += GRAVITY;
+void assignTimeLevels(PhysicsWorld* world, mfloat_t maxDisplacement) {
+    // Fastest per-substep displacement in every region
+    mfloat_t region_speed[TIME_REGION_WIDTH][TIME_REGION_HEIGHT];
+    for (int x = 0; x < TIME_REGION_WIDTH; x++) {
+        for (int y = 0; y < TIME_REGION_HEIGHT; y++) {
+            region_speed[x][y] = 0.0f;
+        }
+    }
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        mfloat_t dx = p->curr_position[0] - p->old_position[0];
+        mfloat_t dy = p->curr_position[1] - p->old_position[1];
+        int old_level = world->time_levels_enabled ? world->particle_level[i] : 0;
+        mfloat_t speed = MSQRT(dx * dx + dy * dy) / (1 << old_level);
+        int rx, ry;
+        regionOf(p->curr_position, &rx, &ry);
+        region_speed[rx][ry] = MFMAX(region_speed[rx][ry], speed);
     }
-}
 
-void applyContainerConstraints(int activeParticles, mfloat_t* containerPos, int container) {
-    for (int i = 0; i < activeParticles; i++) {
-        Particle* p = &(particles[i]);
-        float responseFactor = 0.75;
-        if (container == 0) {
-            if (p->curr_position[0] < (containerPos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + p->radius)) {
-                mfloat_t displacement = p->curr_position[0] - p->old_position[0];
-                p->curr_position[0] = containerPos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + p->radius;
-                p->old_position[0] = p->curr_position[0] + (displacement * responseFactor);
-            }
-            if (p->curr_position[0] > (containerPos[0] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH - p->radius)) {
-                mfloat_t displacement = p->curr_position[0] - p->old_position[0];
-                p->curr_position[0] = containerPos[0] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH - p->radius;
-                p->old_position[0] = p->curr_position[0] + (displacement * responseFactor);
+    for (int x = 0; x < TIME_REGION_WIDTH; x++) {
+        for (int y = 0; y < TIME_REGION_HEIGHT; y++) {
+            int level = 0;
+            while (level < MAX_TIME_LEVEL && region_speed[x][y] * (1 << (level + 1)) <= maxDisplacement) {
+                level++;
             }
+            world->region_level[x][y] = (unsigned char)level;
+        }
+    }
 
-            if (p->curr_position[1] < (containerPos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + p->radius)) {
-                mfloat_t displacement = p->curr_position[1] - p->old_position[1];
-                p->curr_position[1] = containerPos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH + p->radius;
-                p->old_position[1] = p->curr_position[1] + (displacement * responseFactor);
+    // Limit the jump between neighbouring regions to one level so fast
+    // particles never cross straight into a region that steps rarely
+    for (int pass = 0; pass < MAX_TIME_LEVEL; pass++) {
+        for (int x = 0; x < TIME_REGION_WIDTH; x++) {
+            for (int y = 0; y < TIME_REGION_HEIGHT; y++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    for (int dy = -1; dy <= 1; dy++) {
+                        int nx = x + dx;
+                        int ny = y + dy;
+                        if (nx < 0 || nx >= TIME_REGION_WIDTH || ny < 0 || ny >= TIME_REGION_HEIGHT) continue;
+                        if (world->region_level[x][y] > world->region_level[nx][ny] + 1) {
+                            world->region_level[x][y] = world->region_level[nx][ny] + 1;
+                        }
+                    }
+                }
             }
-            if (p->curr_position[1] > (containerPos[1] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH - p->radius)) {
-                mfloat_t displacement = p->curr_position[1] - p->old_position[1];
-                p->curr_position[1] = containerPos[1] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH - p->radius;
-                p->old_position[1] = p->curr_position[1] + (displacement * responseFactor);
+        }
+    }
+
+    // Particles adopt their region's level. A changed step length rescales
+    // the implicit velocity so it stays consistent.
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        int rx, ry;
+        regionOf(p->curr_position, &rx, &ry);
+        int old_level = world->time_levels_enabled ? world->particle_level[i] : 0;
+        int new_level = world->region_level[rx][ry];
+        if (new_level != old_level) {
+            mfloat_t factor = (new_level > old_level) ? (mfloat_t)(1 << (new_level - old_level))
+                                                      : 1.0f / (1 << (old_level - new_level));
+            p->old_position[0] = p->curr_position[0] - (p->curr_position[0] - p->old_position[0]) * factor;
+            p->old_position[1] = p->curr_position[1] - (p->curr_position[1] - p->old_position[1]) * factor;
+        }
+        world->particle_level[i] = (unsigned char)new_level;
+    }
+
+    world->time_levels_enabled = 1;
+    world->current_substep = 0;
+}
+
+void clearTimeLevels(PhysicsWorld* world) {
+    if (!world->time_levels_enabled) return;
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        mfloat_t factor = 1.0f / (1 << world->particle_level[i]);
+        p->old_position[0] = p->curr_position[0] - (p->curr_position[0] - p->old_position[0]) * factor;
+        p->old_position[1] = p->curr_position[1] - (p->curr_position[1] - p->old_position[1]) * factor;
+        world->particle_level[i] = 0;
+    }
+    world->time_levels_enabled = 0;
+}
+
+void beginTimeBlockSubstep(PhysicsWorld* world, int substep) {
+    world->current_substep = substep;
+    if (!world->time_levels_enabled) return;
+
+    for (int x = 0; x < TIME_REGION_WIDTH; x++) {
+        for (int y = 0; y < TIME_REGION_HEIGHT; y++) {
+            world->region_due[x][y] = (unsigned char)isLevelDue(world->region_level[x][y], substep);
+        }
+    }
+    for (int x = 0; x < TIME_REGION_WIDTH; x++) {
+        for (int y = 0; y < TIME_REGION_HEIGHT; y++) {
+            unsigned char near = 0;
+            for (int dx = -1; dx <= 1; dx++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    int nx = x + dx;
+                    int ny = y + dy;
+                    if (nx < 0 || nx >= TIME_REGION_WIDTH || ny < 0 || ny >= TIME_REGION_HEIGHT) continue;
+                    near |= world->region_due[nx][ny];
+                }
             }
+            world->region_near_due[x][y] = near;
+        }
+    }
+}
+
+mfloat_t maxParticleDisplacement(const PhysicsWorld* world) {
+    mfloat_t max_sq = 0.0f;
+    #pragma omp parallel for reduction(max : max_sq)
+    for (int i = 0; i < world->active_particles; i++) {
+        mfloat_t dx = world->particles[i].curr_position[0] - world->particles[i].old_position[0];
+        mfloat_t dy = world->particles[i].curr_position[1] - world->particles[i].old_position[1];
+        // Slow particles under block stepping move 2^level substeps at once
+        mfloat_t level_scale = world->time_levels_enabled ? 1.0f / (1 << world->particle_level[i]) : 1.0f;
+        max_sq = MFMAX(max_sq, (dx * dx + dy * dy) * level_scale * level_scale);
+    }
+    return MSQRT(max_sq);
+}
+
+void rescaleVelocities(PhysicsWorld* world, mfloat_t factor) {
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        p->old_position[0] = p->curr_position[0] - (p->curr_position[0] - p->old_position[0]) * factor;
+        p->old_position[1] = p->curr_position[1] - (p->curr_position[1] - p->old_position[1]) * factor;
+    }
+}
+
+int computeAdaptiveSubsteps(const PhysicsWorld* world, float dt, float prevSubDt,
+                            int minSubsteps, int maxSubsteps, mfloat_t cflFraction) {
+    // Bound the speed over the coming frame by the current maximum plus
+    // what gravity can add during it
+    mfloat_t speed = maxParticleDisplacement(world) / prevSubDt + MFABS(world->gravity) * dt;
+    mfloat_t max_step = cflFraction * PARTICLE_RADIUS;
+    int substeps = (int)MCEIL(speed * dt / max_step);
+    if (substeps < minSubsteps) substeps = minSubsteps;
+    if (substeps > maxSubsteps) substeps = maxSubsteps;
+    return substeps;
+}
+
+void applyGravity(PhysicsWorld* world) {
+    for (int i = 0; i < world->active_particles; i++) {
+        world->particles[i].acceleration[1] += world->gravity;
+    }
+}
+
+typedef void (*ContainerKernel)(PhysicsWorld* world);
+
+// The collision layers when any particle uses them, NULL otherwise
+static inline const CollisionLayers* activeLayers(const PhysicsWorld* world) {
+    return (world->layers && world->layers->enabled) ? world->layers : NULL;
+}
+
+// The pair table when species materials are in use, NULL otherwise
+static inline const PairTable* contactMaterials(const PhysicsWorld* world) {
+    return (world->pairs && world->pairs->materials_enabled) ? world->pairs : NULL;
+}
+
+// Wall restitution of particle i
+static inline mfloat_t wallResponse(const PhysicsWorld* world, const PairTable* materials, int i) {
+    return materials ? materials->materials[materials->particle_species[i]].restitution : world->container_response;
+}
+
+// Clamps one axis to [lo, hi]. A clamped particle has its velocity along
+// the axis reflected and scaled by response; the select compiles to a
+// blend instead of a branch. Returns 1 if pushed off the lo wall, -1 if
+// pushed off the hi wall and 0 otherwise.
+static inline int clampAxis(mfloat_t* curr, mfloat_t* old, mfloat_t lo, mfloat_t hi, mfloat_t response) {
+    mfloat_t displacement = *curr - *old;
+    mfloat_t clamped = MFMIN(MFMAX(*curr, lo), hi);
+    int hit = (clamped > *curr) - (clamped < *curr);
+    *old = (clamped != *curr) ? clamped + displacement * response : *old;
+    *curr = clamped;
+    return hit;
+}
+
+// Moves a particle touching a wall towards the wall temperature
+static inline void exchangeWallHeat(const PhysicsWorld* world, Particle* p, int wall) {
+    p->temperature += world->wall_heat_transfer[wall] * (world->wall_temperature[wall] - p->temperature);
+}
+
+static void applyBoxContainer(PhysicsWorld* world) {
+    const mfloat_t* containerPos = world->container_pos;
+    const mfloat_t min_x = containerPos[0] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    const mfloat_t max_x = containerPos[0] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH;
+    const mfloat_t min_y = containerPos[1] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+    const mfloat_t max_y = containerPos[1] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH;
+    const PairTable* materials = contactMaterials(world);
+
+    #pragma omp parallel for simd schedule(static)
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        mfloat_t r = p->radius;
+        mfloat_t response = wallResponse(world, materials, i);
+        int hit_x = clampAxis(&p->curr_position[0], &p->old_position[0], min_x + r, max_x - r, response);
+        int hit_y = clampAxis(&p->curr_position[1], &p->old_position[1], min_y + r, max_y - r, response);
+        if (hit_x) exchangeWallHeat(world, p, hit_x > 0 ? WALL_LEFT : WALL_RIGHT);
+        if (hit_y) exchangeWallHeat(world, p, hit_y > 0 ? WALL_BOTTOM : WALL_TOP);
+    }
+}
+
+static void applyCircleContainer(PhysicsWorld* world) {
+    const mfloat_t cx = world->container_pos[0];
+    const mfloat_t cy = world->container_pos[1];
+    const PairTable* materials = contactMaterials(world);
+
+    #pragma omp parallel for simd schedule(static)
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        mfloat_t dx = p->curr_position[0] - cx;
+        mfloat_t dy = p->curr_position[1] - cy;
+        mfloat_t dist = MSQRT(dx * dx + dy * dy);
+        // scale is 1 inside the container, so the correction vanishes
+        mfloat_t scale = MFMIN((CONTAINER_SIZE - p->radius) / (dist + MFLT_EPSILON), 1.0f);
+        mfloat_t vx = p->curr_position[0] - p->old_position[0];
+        mfloat_t vy = p->curr_position[1] - p->old_position[1];
+        p->curr_position[0] += dx * (scale - 1.0f);
+        p->curr_position[1] += dy * (scale - 1.0f);
+        if (scale < 1.0f) {
+            // Reflect the outward velocity, keeping the response share of it
+            mfloat_t outward = MFMAX(vx * dx + vy * dy, 0.0f) / (dist * dist + MFLT_EPSILON);
+            mfloat_t bounce = (1.0f + wallResponse(world, materials, i)) * outward;
+            p->old_position[0] = p->curr_position[0] - (vx - bounce * dx);
+            p->old_position[1] = p->curr_position[1] - (vy - bounce * dy);
+            exchangeWallHeat(world, p, dy < 0.0f ? WALL_BOTTOM : WALL_TOP);
         }
-        if (container == 1) {
-            mfloat_t displacement[VEC2_SIZE];
-            vec2_subtract(displacement, p->curr_position, containerPos);
-            mfloat_t dist = vec2_length(displacement);
-            if (dist > CONTAINER_SIZE - p->radius) {
-                mfloat_t normDisplacement[VEC2_SIZE];
-                vec2_divide_f(normDisplacement, displacement, dist);
-                vec2_multiply_f(normDisplacement, normDisplacement, CONTAINER_SIZE - p->radius);
-                vec2_add(p->curr_position, containerPos, normDisplacement);
+    }
+}
+
+static void applySdfContainer(PhysicsWorld* world) {
+    applySdfCollider(world);
+}
+
+// Wrapped axes move particles that left the box by one period, keeping
+// their velocity; the other axes clamp like the box container
+static void applyPeriodicContainer(PhysicsWorld* world) {
+    mfloat_t lo[VEC2_SIZE];
+    mfloat_t hi[VEC2_SIZE];
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        lo[axis] = world->container_pos[axis] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH;
+        hi[axis] = world->container_pos[axis] + CONTAINER_SIZE - CONTAINER_BORDER_WIDTH;
+    }
+    const PairTable* materials = contactMaterials(world);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < world->active_particles; i++) {
+        Particle* p = &(world->particles[i]);
+        for (int axis = 0; axis < VEC2_SIZE; axis++) {
+            if (world->periodic[axis]) {
+                mfloat_t shift = (p->curr_position[axis] < lo[axis]) ? (mfloat_t)CONTAINER_PERIOD
+                               : (p->curr_position[axis] >= hi[axis]) ? -(mfloat_t)CONTAINER_PERIOD : 0.0f;
+                p->curr_position[axis] += shift;
+                p->old_position[axis] += shift;
+                continue;
+            }
+            mfloat_t r = p->radius;
+            int hit = clampAxis(&p->curr_position[axis], &p->old_position[axis], lo[axis] + r, hi[axis] - r,
+                                wallResponse(world, materials, i));
+            if (hit) {
+                int wall = (axis == 0) ? (hit > 0 ? WALL_LEFT : WALL_RIGHT) : (hit > 0 ? WALL_BOTTOM : WALL_TOP);
+                exchangeWallHeat(world, p, wall);
             }
         }
     }
 }
 
-void fixCollisions(Particle* p1, Particle* p2) {
+// Indexed by the container type: box = 0, circle = 1, signed distance field = 2, periodic box = 3
+static const ContainerKernel containerKernels[] = {
+    applyBoxContainer,
+    applyCircleContainer,
+    applySdfContainer,
+    applyPeriodicContainer
+};
+
+void applyContainerConstraints(PhysicsWorld* world) {
+    int container = world->container;
+    if (container < 0 || container >= (int)(sizeof(containerKernels) / sizeof(containerKernels[0]))) return;
+    containerKernels[container](world);
+}
+
+int setPeriodicBoundaries(PhysicsWorld* world, bool wrapX, bool wrapY) {
+    const bool wrap[VEC2_SIZE] = {wrapX, wrapY};
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        if (!wrap[axis]) continue;
+        // Wrapped neighbour cells must hold exactly the particles one period away
+        mfloat_t lo = (world->container_pos[axis] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH) / GRID_CELL_SIZE;
+        mfloat_t cells = CONTAINER_PERIOD / GRID_CELL_SIZE;
+        if (lo != MFLOOR(lo) || cells != MFLOOR(cells) || cells < 3.0f) {
+            printf("Error: the periodic box sides along axis %d do not lie on grid lines\n", axis);
+            return -1;
+        }
+    }
+    world->container = 3;
+    world->periodic[0] = wrapX;
+    world->periodic[1] = wrapY;
+    return 0;
+}
+
+// First grid cell inside the periodic box along axis
+static inline int periodicCellLo(const PhysicsWorld* world, int axis) {
+    return (int)((world->container_pos[axis] - CONTAINER_SIZE + CONTAINER_BORDER_WIDTH) / GRID_CELL_SIZE);
+}
+
+// Maps a neighbour cell index that stepped off one side of the periodic
+// box onto the cell one period away
+static inline int wrapCell(int cell, int lo, int count) {
+    return cell < lo ? cell + count : (cell >= lo + count ? cell - count : cell);
+}
+
+mfloat_t periodicWrap(const PhysicsWorld* world, int axis) {
+    return (world->container == 3 && world->periodic[axis]) ? (mfloat_t)CONTAINER_PERIOD : 0.0f;
+}
+
+// Replaces a separation along wrapped axes by the one to the nearest
+// periodic image
+static inline void minimumImage(const PhysicsWorld* world, mfloat_t* separation) {
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        if (!world->periodic[axis]) continue;
+        separation[axis] = wrapSeparation(separation[axis], (mfloat_t)CONTAINER_PERIOD);
+    }
+}
+
+// Separates an overlapping pair by correction along norm, split by mass,
+// then gives the pair its restitution and Coulomb friction. Velocities are
+// curr - old, so the velocity change is applied through the old positions.
+static inline void resolveMaterialContact(const PhysicsWorld* world, const PairTable* materials, Particle* p1,
+                                          Particle* p2, const mfloat_t* norm, mfloat_t correction) {
+    const unsigned char* species = materials->particle_species;
+    const ContactMaterial* contact =
+        &materials->contact_table[species[p1 - world->particles]][species[p2 - world->particles]];
+    const mfloat_t share1 = contact->share;
+    const mfloat_t share2 = 1.0f - share1;
+
+    // Relative velocity of p1 against p2 before the correction
+    mfloat_t v[VEC2_SIZE];
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        v[axis] = (p1->curr_position[axis] - p1->old_position[axis]) - (p2->curr_position[axis] - p2->old_position[axis]);
+    }
+    mfloat_t vn = v[0] * norm[0] + v[1] * norm[1];
+
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        p1->curr_position[axis] += norm[axis] * correction * share1;
+        p2->curr_position[axis] -= norm[axis] * correction * share2;
+    }
+    if (vn >= 0.0f) return; // Already separating
+
+    // The correction already separates the pair at its own length per
+    // step; add only what is missing for e times the approach speed
+    mfloat_t e = contact->restitution;
+    mfloat_t dvn = MFMAX(-e * vn - (vn + correction), 0.0f);
+    mfloat_t vt[VEC2_SIZE] = {v[0] - vn * norm[0], v[1] - vn * norm[1]};
+    mfloat_t vt_length = MSQRT(vt[0] * vt[0] + vt[1] * vt[1]);
+    // Friction can stop the slide up to mu times the normal impulse
+    mfloat_t stop = MFMIN(contact->friction * -(1.0f + e) * vn / (vt_length + MFLT_EPSILON), 1.0f);
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        mfloat_t d = norm[axis] * dvn - vt[axis] * stop;
+        p1->old_position[axis] -= d * share1;
+        p2->old_position[axis] += d * share2;
+    }
+}
+
+// recordEvents and periodic are literals at the grid call sites, so the
+// checks compile away. materials is NULL unless species materials are on.
+static inline void resolveContact(PhysicsWorld* world, Particle* p1, Particle* p2, const PairTable* materials,
+                                  const int recordEvents, const int periodic) {
     mfloat_t collision_axis[VEC2_SIZE];
     vec2_subtract(collision_axis, p1->curr_position, p2->curr_position);
+    if (periodic) minimumImage(world, collision_axis);
     mfloat_t dist = vec2_length(collision_axis);
     if (dist < (p1->radius + p2->radius)) {
         mfloat_t norm[VEC2_SIZE];
-        vec2_divide_f(norm, collision_axis, dist);
+        // Coincident particles have no axis to separate along
+        vec2_divide_f(norm, collision_axis, dist + MFLT_EPSILON);
         mfloat_t delta = (p1->radius + p2->radius) - dist;
-        vec2_multiply_f(norm, norm, 0.5 * 0.75 * delta);
-        vec2_add(p1->curr_position, p1->curr_position, norm);
-        vec2_subtract(p2->curr_position, p2->curr_position, norm);
+        if (recordEvents) {
+            // Closing speed along the normal from the Verlet velocities
+            mfloat_t closing = ((p2->curr_position[0] - p2->old_position[0]) - (p1->curr_position[0] - p1->old_position[0])) * norm[0]
+                             + ((p2->curr_position[1] - p2->old_position[1]) - (p1->curr_position[1] - p1->old_position[1])) * norm[1];
+            if (closing > world->events->threshold) {
+                recordCollisionEvent(world->events, (int)(p1 - world->particles), (int)(p2 - world->particles), delta, closing);
+            }
+        }
+        if (materials) {
+            resolveMaterialContact(world, materials, p1, p2, norm, world->collision_response * delta);
+        } else {
+            // Each particle takes half of the damped correction
+            vec2_multiply_f(norm, norm, 0.5f * world->collision_response * delta);
+            vec2_add(p1->curr_position, p1->curr_position, norm);
+            vec2_subtract(p2->curr_position, p2->curr_position, norm);
+        }
+
+        // Conduction between touching particles
+        mfloat_t heat = HEAT_CONDUCTIVITY * (p2->temperature - p1->temperature);
+        p1->temperature += heat;
+        p2->temperature -= heat;
     }
 }
 
-void detectCollisions(int activeParticles) {
+void fixCollisions(PhysicsWorld* world, Particle* p1, Particle* p2) {
+    const CollisionLayers* layers = activeLayers(world);
+    if (layers) {
+        int i1 = (int)(p1 - world->particles);
+        int i2 = (int)(p2 - world->particles);
+        if (!layersInteract(layers->category[i1], layers->mask[i1], layers->category[i2], layers->mask[i2])) return;
+    }
+    resolveContact(world, p1, p2, contactMaterials(world), 0, world->container == 3);
+}
+
+static inline int gridCellX(const mfloat_t* position) {
+    int cell_x = (int)(position[0] / GRID_CELL_SIZE);
+    if (cell_x < 0) cell_x = 0;
+    else if (cell_x >= GRID_WIDTH) cell_x = GRID_WIDTH - 1;
+    return cell_x;
+}
+
+static inline int gridCellY(const mfloat_t* position) {
+    int cell_y = (int)(position[1] / GRID_CELL_SIZE);
+    if (cell_y < 0) cell_y = 0;
+    else if (cell_y >= GRID_HEIGHT) cell_y = GRID_HEIGHT - 1;
+    return cell_y;
+}
+
+void populateGrid(PhysicsWorld* world) {
     // Clear grid cells
     for (int i = 0; i < GRID_WIDTH; i++) {
         for (int j = 0; j < GRID_HEIGHT; j++) {
-            grid[i][j].num_particles = 0;
+            gridAt(world, i, j)->num_particles = 0;
         }
     }
 
     // Assign particles to grid cells
-    for (int p_idx = 0; p_idx < activeParticles; p_idx++) {
-        Particle* p = &particles[p_idx];
+    for (int p_idx = 0; p_idx < world->active_particles; p_idx++) {
+        insertIntoGrid(world, p_idx);
+    }
+}
 
-        // Compute cell indices
-        int cell_x = (int)(p->curr_position[0] / GRID_CELL_SIZE);
-        int cell_y = (int)(p->curr_position[1] / GRID_CELL_SIZE);
+void insertIntoGrid(PhysicsWorld* world, int p_idx) {
+    Particle* p = &world->particles[p_idx];
 
-        // Ensure indices are within grid bounds
-        if (cell_x < 0) cell_x = 0;
-        else if (cell_x >= GRID_WIDTH) cell_x = GRID_WIDTH - 1;
+    // Compute cell indices, clamped to the grid bounds
+    int cell_x = gridCellX(p->curr_position);
+    int cell_y = gridCellY(p->curr_position);
 
-        if (cell_y < 0) cell_y = 0;
-        else if (cell_y >= GRID_HEIGHT) cell_y = GRID_HEIGHT - 1;
+    // Add particle to grid cell
+    GridCell* cell = gridAt(world, cell_x, cell_y);
+    if (cell->num_particles < MAX_PARTICLES_PER_CELL) {
+        cell->particle_indices[cell->num_particles++] = p_idx;
+    } else {
+        // Handle error: too many particles in cell
+        printf("Error: too many particles in cell (%d, %d)\n", cell_x, cell_y);
+    }
+}
 
-        // Add particle to grid cell
-        GridCell* cell = &grid[cell_x][cell_y];
-        if (cell->num_particles < MAX_PARTICLES_PER_CELL) {
-            cell->particle_indices[cell->num_particles++] = p_idx;
-        } else {
-            // Handle error: too many particles in cell
-            printf("Error: too many particles in cell (%d, %d)\n", cell_x, cell_y);
+// First cell and cell count of the periodic box along each wrapped axis.
+// Other axes get a count of 0, for which wrapCell leaves in-grid cells as
+// they are.
+static void periodicCells(const PhysicsWorld* world, int* cell_lo, int* cell_count) {
+    for (int axis = 0; axis < VEC2_SIZE; axis++) {
+        cell_lo[axis] = 0;
+        cell_count[axis] = 0;
+        if (periodicWrap(world, axis) > 0.0f) {
+            cell_lo[axis] = periodicCellLo(world, axis);
+            cell_count[axis] = (int)(CONTAINER_PERIOD / GRID_CELL_SIZE);
         }
     }
+}
 
-    // Collision detection using grid
-    for (int i = 0; i < GRID_WIDTH; i++) {
-        for (int j = 0; j < GRID_HEIGHT; j++) {
-            GridCell* cell = &grid[i][j];
-            for (int idx1 = 0; idx1 < cell->num_particles; idx1++) {
-                int p_idx1 = cell->particle_indices[idx1];
-                Particle* p1 = &particles[p_idx1];
-
-                // Check collisions in same and neighboring cells
-                for (int di = -1; di <= 1; di++) {
-                    int ni = i + di;
-                    if (ni < 0 || ni >= GRID_WIDTH) continue;
-                    for (int dj = -1; dj <= 1; dj++) {
-                        int nj = j + dj;
-                        if (nj < 0 || nj >= GRID_HEIGHT) continue;
-
-                        GridCell* neighbor_cell = &grid[ni][nj];
-                        for (int idx2 = 0; idx2 < neighbor_cell->num_particles; idx2++) {
-                            int p_idx2 = neighbor_cell->particle_indices[idx2];
-                            if (p_idx2 <= p_idx1) continue; // avoid double checking and self-check
-
-                            Particle* p2 = &particles[p_idx2];
-                            fixCollisions(p1, p2);
-                        }
+// Cells first..last that cover lo..hi along one axis. They are clamped to
+// the grid, or along a wrapped axis left to wrapCell and capped at one
+// period so no cell is visited twice.
+static inline void cellRange(int lo, int hi, int size, int period_lo, int period_count, int* first, int* last) {
+    if (period_count > 0) {
+        *first = hi - lo >= period_count ? period_lo : lo;
+        *last = hi - lo >= period_count ? period_lo + period_count - 1 : hi;
+    } else {
+        *first = lo < 0 ? 0 : lo;
+        *last = hi >= size ? size - 1 : hi;
+    }
+}
+
+int buildNeighborLists(PhysicsWorld* world, mfloat_t radius) {
+    populateGrid(world);
+
+    const int reach = (int)MCEIL(radius / GRID_CELL_SIZE);
+    const mfloat_t radius_sq = radius * radius;
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+    int cell_lo[VEC2_SIZE];
+    int cell_count[VEC2_SIZE];
+    periodicCells(world, cell_lo, cell_count);
+
+    // Count pass: each particle writes only its own count, so the gather
+    // over neighbouring cells runs in parallel
+    #pragma omp parallel for schedule(static)
+    for (int p_idx = 0; p_idx < world->active_particles; p_idx++) {
+        const mfloat_t* pos = world->particles[p_idx].curr_position;
+        int ci = gridCellX(pos);
+        int cj = gridCellY(pos);
+        int i_lo, i_hi, j_lo, j_hi;
+        cellRange(ci - reach, ci + reach, GRID_WIDTH, cell_lo[0], cell_count[0], &i_lo, &i_hi);
+        cellRange(cj - reach, cj + reach, GRID_HEIGHT, cell_lo[1], cell_count[1], &j_lo, &j_hi);
+        int count = 0;
+        for (int si = i_lo; si <= i_hi; si++) {
+            int ni = wrapCell(si, cell_lo[0], cell_count[0]);
+            for (int sj = j_lo; sj <= j_hi; sj++) {
+                int nj = wrapCell(sj, cell_lo[1], cell_count[1]);
+                GridCell* cell = gridAt(world, ni, nj);
+                for (int k = 0; k < cell->num_particles; k++) {
+                    const mfloat_t* other = world->particles[cell->particle_indices[k]].curr_position;
+                    mfloat_t dx = wrapSeparation(other[0] - pos[0], wrap[0]);
+                    mfloat_t dy = wrapSeparation(other[1] - pos[1], wrap[1]);
+                    count += (dx * dx + dy * dy < radius_sq);
+                }
+            }
+        }
+        world->neighbor_offsets[p_idx + 1] = count;
+    }
+
+    world->neighbor_offsets[0] = 0;
+    for (int p_idx = 0; p_idx < world->active_particles; p_idx++) {
+        world->neighbor_offsets[p_idx + 1] += world->neighbor_offsets[p_idx];
+    }
+
+    int total = world->neighbor_offsets[world->active_particles];
+    if (total > world->neighbor_capacity) {
+        int* grown = (int*)realloc(world->neighbor_indices, total * 2 * sizeof(int));
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate memory for neighbor lists\n");
+            return -1;
+        }
+        world->neighbor_indices = grown;
+        world->neighbor_capacity = total * 2;
+    }
+
+    // Fill pass, same traversal order as the count pass
+    #pragma omp parallel for schedule(static)
+    for (int p_idx = 0; p_idx < world->active_particles; p_idx++) {
+        const mfloat_t* pos = world->particles[p_idx].curr_position;
+        int ci = gridCellX(pos);
+        int cj = gridCellY(pos);
+        int i_lo, i_hi, j_lo, j_hi;
+        cellRange(ci - reach, ci + reach, GRID_WIDTH, cell_lo[0], cell_count[0], &i_lo, &i_hi);
+        cellRange(cj - reach, cj + reach, GRID_HEIGHT, cell_lo[1], cell_count[1], &j_lo, &j_hi);
+        int out = world->neighbor_offsets[p_idx];
+        for (int si = i_lo; si <= i_hi; si++) {
+            int ni = wrapCell(si, cell_lo[0], cell_count[0]);
+            for (int sj = j_lo; sj <= j_hi; sj++) {
+                int nj = wrapCell(sj, cell_lo[1], cell_count[1]);
+                GridCell* cell = gridAt(world, ni, nj);
+                for (int k = 0; k < cell->num_particles; k++) {
+                    int other_idx = cell->particle_indices[k];
+                    const mfloat_t* other = world->particles[other_idx].curr_position;
+                    mfloat_t dx = wrapSeparation(other[0] - pos[0], wrap[0]);
+                    mfloat_t dy = wrapSeparation(other[1] - pos[1], wrap[1]);
+                    if (dx * dx + dy * dy < radius_sq) {
+                        world->neighbor_indices[out++] = other_idx;
                     }
                 }
             }
         }
     }
+
+    return total;
+}
+
+// Particles keep moving after the grid is built, so queries widen their
+// search by this much and test current positions
+#define QUERY_MARGIN (0.5f * GRID_CELL_SIZE)
+#define RAY_MISS 2.0f // Any fraction past the end of the segment
+
+static inline int clampCellX(int cell_x) {
+    return cell_x < 0 ? 0 : (cell_x >= GRID_WIDTH ? GRID_WIDTH - 1 : cell_x);
+}
+
+static inline int clampCellY(int cell_y) {
+    return cell_y < 0 ? 0 : (cell_y >= GRID_HEIGHT ? GRID_HEIGHT - 1 : cell_y);
+}
+
+// Collects particles whose centers satisfy the box or circle test. Every
+// particle sits in exactly one cell, so results hold no duplicates. In the
+// periodic box each particle is tested at its image nearest the middle of
+// the box, which must not be wider than one period.
+static int queryCells(const PhysicsWorld* world, const mfloat_t* min, const mfloat_t* max, const mfloat_t* center,
+                      mfloat_t radius_sq, int* results, int maxResults) {
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+    const mfloat_t mid[VEC2_SIZE] = {0.5f * (min[0] + max[0]), 0.5f * (min[1] + max[1])};
+    int cell_lo[VEC2_SIZE];
+    int cell_count[VEC2_SIZE];
+    periodicCells(world, cell_lo, cell_count);
+    int i_lo, i_hi, j_lo, j_hi;
+    cellRange((int)MFLOOR((min[0] - QUERY_MARGIN) / GRID_CELL_SIZE), (int)MFLOOR((max[0] + QUERY_MARGIN) / GRID_CELL_SIZE),
+              GRID_WIDTH, cell_lo[0], cell_count[0], &i_lo, &i_hi);
+    cellRange((int)MFLOOR((min[1] - QUERY_MARGIN) / GRID_CELL_SIZE), (int)MFLOOR((max[1] + QUERY_MARGIN) / GRID_CELL_SIZE),
+              GRID_HEIGHT, cell_lo[1], cell_count[1], &j_lo, &j_hi);
+    int count = 0;
+    for (int si = i_lo; si <= i_hi; si++) {
+        int ni = clampCellX(wrapCell(si, cell_lo[0], cell_count[0]));
+        for (int sj = j_lo; sj <= j_hi; sj++) {
+            int nj = clampCellY(wrapCell(sj, cell_lo[1], cell_count[1]));
+            const GridCell* cell = gridAt(world, ni, nj);
+            for (int k = 0; k < cell->num_particles; k++) {
+                int p_idx = cell->particle_indices[k];
+                const mfloat_t* curr = world->particles[p_idx].curr_position;
+                // Shifts by whole periods only; unchanged when nothing wraps
+                mfloat_t pos[VEC2_SIZE] = {
+                    curr[0] + (wrapSeparation(curr[0] - mid[0], wrap[0]) - (curr[0] - mid[0])),
+                    curr[1] + (wrapSeparation(curr[1] - mid[1], wrap[1]) - (curr[1] - mid[1]))};
+                int inside = pos[0] >= min[0] && pos[0] <= max[0] && pos[1] >= min[1] && pos[1] <= max[1];
+                if (inside && center) {
+                    mfloat_t dx = pos[0] - center[0];
+                    mfloat_t dy = pos[1] - center[1];
+                    inside = dx * dx + dy * dy <= radius_sq;
+                }
+                if (inside) {
+                    if (count < maxResults) results[count] = p_idx;
+                    count++;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+int queryRadius(const PhysicsWorld* world, const mfloat_t* center, mfloat_t radius, int* results, int maxResults) {
+    mfloat_t min[VEC2_SIZE] = {center[0] - radius, center[1] - radius};
+    mfloat_t max[VEC2_SIZE] = {center[0] + radius, center[1] + radius};
+    return queryCells(world, min, max, center, radius * radius, results, maxResults);
+}
+
+int queryAabb(const PhysicsWorld* world, const mfloat_t* min, const mfloat_t* max, int* results, int maxResults) {
+    return queryCells(world, min, max, NULL, 0.0f, results, maxResults);
+}
+
+// Tests the segment start + t * delta, t in [0, 1], against every particle
+// within reach of cell (ci, cj) and keeps the earliest hit
+static void raycastCellNeighborhood(const PhysicsWorld* world, int ci, int cj, int reach, const mfloat_t* start, const mfloat_t* delta,
+                                    mfloat_t* best_t, int* best_idx) {
+    const mfloat_t a = delta[0] * delta[0] + delta[1] * delta[1];
+    for (int ni = clampCellX(ci - reach); ni <= clampCellX(ci + reach); ni++) {
+        for (int nj = clampCellY(cj - reach); nj <= clampCellY(cj + reach); nj++) {
+            const GridCell* cell = gridAt(world, ni, nj);
+            for (int k = 0; k < cell->num_particles; k++) {
+                int p_idx = cell->particle_indices[k];
+                const Particle* p = &world->particles[p_idx];
+                mfloat_t fx = start[0] - p->curr_position[0];
+                mfloat_t fy = start[1] - p->curr_position[1];
+                mfloat_t b = fx * delta[0] + fy * delta[1];
+                mfloat_t c = fx * fx + fy * fy - p->radius * p->radius;
+                mfloat_t t = RAY_MISS;
+                if (c <= 0.0f) {
+                    t = 0.0f; // The segment starts inside this particle
+                } else if (a > 0.0f && b < 0.0f && b * b - a * c >= 0.0f) {
+                    t = (-b - MSQRT(b * b - a * c)) / a;
+                }
+                if (t <= 1.0f && (t < *best_t || (t == *best_t && p_idx < *best_idx))) {
+                    *best_t = t;
+                    *best_idx = p_idx;
+                }
+            }
+        }
+    }
+}
+
+int raycastParticles(const PhysicsWorld* world, const mfloat_t* start, const mfloat_t* end, mfloat_t* hitFraction) {
+    const mfloat_t delta[VEC2_SIZE] = {end[0] - start[0], end[1] - start[1]};
+    const mfloat_t extent[VEC2_SIZE] = {GRID_WIDTH * GRID_CELL_SIZE, GRID_HEIGHT * GRID_CELL_SIZE};
+
+    // Clip the segment to the grid
+    mfloat_t t_enter = 0.0f;
+    mfloat_t t_exit = 1.0f;
+    for (int axis = 0; axis < 2; axis++) {
+        if (MFABS(delta[axis]) < MFLT_EPSILON) {
+            if (start[axis] < 0.0f || start[axis] > extent[axis]) return -1;
+            continue;
+        }
+        mfloat_t ta = -start[axis] / delta[axis];
+        mfloat_t tb = (extent[axis] - start[axis]) / delta[axis];
+        t_enter = MFMAX(t_enter, MFMIN(ta, tb));
+        t_exit = MFMIN(t_exit, MFMAX(ta, tb));
+    }
+    if (t_enter > t_exit) return -1;
+
+    // Walk the cells the segment crosses in order. A hit inside a cell
+    // belongs to a particle at most reach cells away, so once a cell is
+    // entered after the best hit so far nothing closer can follow.
+    const int reach = (int)MCEIL((PARTICLE_RADIUS + QUERY_MARGIN) / GRID_CELL_SIZE);
+    int ci = clampCellX((int)((start[0] + t_enter * delta[0]) / GRID_CELL_SIZE));
+    int cj = clampCellY((int)((start[1] + t_enter * delta[1]) / GRID_CELL_SIZE));
+    int step_i = delta[0] > 0.0f ? 1 : -1;
+    int step_j = delta[1] > 0.0f ? 1 : -1;
+    mfloat_t t_delta_i = MFABS(delta[0]) < MFLT_EPSILON ? RAY_MISS : GRID_CELL_SIZE / MFABS(delta[0]);
+    mfloat_t t_delta_j = MFABS(delta[1]) < MFLT_EPSILON ? RAY_MISS : GRID_CELL_SIZE / MFABS(delta[1]);
+    mfloat_t t_next_i = MFABS(delta[0]) < MFLT_EPSILON ? RAY_MISS
+                      : ((ci + (step_i > 0)) * GRID_CELL_SIZE - start[0]) / delta[0];
+    mfloat_t t_next_j = MFABS(delta[1]) < MFLT_EPSILON ? RAY_MISS
+                      : ((cj + (step_j > 0)) * GRID_CELL_SIZE - start[1]) / delta[1];
+
+    mfloat_t best_t = RAY_MISS;
+    int best_idx = -1;
+    mfloat_t t_cell = t_enter;
+    while (t_cell <= t_exit && t_cell <= best_t) {
+        raycastCellNeighborhood(world, ci, cj, reach, start, delta, &best_t, &best_idx);
+        if (t_next_i < t_next_j) {
+            ci += step_i;
+            t_cell = t_next_i;
+            t_next_i += t_delta_i;
+        } else {
+            cj += step_j;
+            t_cell = t_next_j;
+            t_next_j += t_delta_j;
+        }
+        if (ci < 0 || ci >= GRID_WIDTH || cj < 0 || cj >= GRID_HEIGHT) break;
+    }
+
+    if (best_idx >= 0 && hitFraction) *hitFraction = best_t;
+    return best_idx;
+}
+
+// Generates the grid collision pass. RECORD_EVENTS and PERIODIC are
+// literals, so each variant contains only the code its scene needs.
+#define DEFINE_COLLIDE_GRID(name, RECORD_EVENTS, PERIODIC)                                                 \
+    static void name(PhysicsWorld* world) {                                                                \
+        /* Periodic box cells, so neighbour cells across a wrapped side map back inside */                 \
+        int cell_lo[VEC2_SIZE] = {0, 0};                                                                   \
+        int cell_count[VEC2_SIZE] = {GRID_WIDTH, GRID_HEIGHT};                                             \
+        const PairTable* materials = contactMaterials(world);                                              \
+        const CollisionLayers* layers = activeLayers(world);                                               \
+        if (PERIODIC) {                                                                                    \
+            for (int axis = 0; axis < VEC2_SIZE; axis++) {                                                 \
+                if (!world->periodic[axis]) continue;                                                      \
+                cell_lo[axis] = periodicCellLo(world, axis);                                               \
+                cell_count[axis] = (int)(CONTAINER_PERIOD / GRID_CELL_SIZE);                               \
+            }                                                                                              \
+        }                                                                                                  \
+                                                                                                           \
+        /* Collision detection using grid */                                                               \
+        for (int i = 0; i < GRID_WIDTH; i++) {                                                             \
+            for (int j = 0; j < GRID_HEIGHT; j++) {                                                        \
+                GridCell* cell = gridAt(world, i, j);                                                      \
+                if (world->time_levels_enabled) {                                                          \
+                    /* Pairs where neither side steps this substep can wait */                             \
+                    int rx = (int)(i * GRID_CELL_SIZE) / TIME_REGION_SIZE;                                 \
+                    int ry = (int)(j * GRID_CELL_SIZE) / TIME_REGION_SIZE;                                 \
+                    if (rx >= TIME_REGION_WIDTH) rx = TIME_REGION_WIDTH - 1;                               \
+                    if (ry >= TIME_REGION_HEIGHT) ry = TIME_REGION_HEIGHT - 1;                             \
+                    if (!world->region_near_due[rx][ry]) continue;                                         \
+                }                                                                                          \
+                for (int idx1 = 0; idx1 < cell->num_particles; idx1++) {                                   \
+                    int p_idx1 = cell->particle_indices[idx1];                                             \
+                    Particle* p1 = &world->particles[p_idx1];                                              \
+                    unsigned int category1 = layers ? layers->category[p_idx1] : LAYER_ALL;                \
+                    unsigned int mask1 = layers ? layers->mask[p_idx1] : LAYER_ALL;                        \
+                                                                                                           \
+                    /* Check collisions in same and neighboring cells */                                   \
+                    for (int di = -1; di <= 1; di++) {                                                     \
+                        int ni = i + di;                                                                   \
+                        if (PERIODIC && world->periodic[0]) {                                              \
+                            ni = wrapCell(ni, cell_lo[0], cell_count[0]);                                  \
+                        }                                                                                  \
+                        if (ni < 0 || ni >= GRID_WIDTH) continue;                                          \
+                        for (int dj = -1; dj <= 1; dj++) {                                                 \
+                            int nj = j + dj;                                                               \
+                            if (PERIODIC && world->periodic[1]) {                                          \
+                                nj = wrapCell(nj, cell_lo[1], cell_count[1]);                              \
+                            }                                                                              \
+                            if (nj < 0 || nj >= GRID_HEIGHT) continue;                                     \
+                            /* Nothing in the neighbour cell can meet p1's layers */                       \
+                            int cell_idx = ni * GRID_HEIGHT + nj;                                          \
+                            if (layers && !layersInteract(category1, mask1,                                \
+                                                          layers->cell_category[cell_idx],                 \
+                                                          layers->cell_mask[cell_idx])) continue;          \
+                                                                                                           \
+                            GridCell* neighbor_cell = gridAt(world, ni, nj);                               \
+                            for (int idx2 = 0; idx2 < neighbor_cell->num_particles; idx2++) {              \
+                                int p_idx2 = neighbor_cell->particle_indices[idx2];                        \
+                                if (p_idx2 <= p_idx1) continue; /* avoid double checking and self-check */ \
+                                if (layers && !layersInteract(category1, mask1, layers->category[p_idx2],  \
+                                                              layers->mask[p_idx2])) continue;             \
+                                                                                                           \
+                                Particle* p2 = &world->particles[p_idx2];                                  \
+                                resolveContact(world, p1, p2, materials, RECORD_EVENTS, PERIODIC);         \
+                            }                                                                              \
+                        }                                                                                  \
+                    }                                                                                      \
+                }                                                                                          \
+            }                                                                                              \
+        }                                                                                                  \
+    }
+
+DEFINE_COLLIDE_GRID(collideGrid, 0, 0)
+DEFINE_COLLIDE_GRID(collideGridWithEvents, 1, 0)
+DEFINE_COLLIDE_GRID(collidePeriodicGrid, 0, 1)
+DEFINE_COLLIDE_GRID(collidePeriodicGridWithEvents, 1, 1)
+
+void detectCollisions(PhysicsWorld* world) {
+    populateGrid(world);
+    if (activeLayers(world)) updateCellLayers(world);
+    bool events = world->events && world->events->enabled;
+    if (world->container == 3) {
+        if (events) collidePeriodicGridWithEvents(world);
+        else collidePeriodicGrid(world);
+    } else if (events) {
+        collideGridWithEvents(world);
+    } else {
+        collideGrid(world);
+    }
 }
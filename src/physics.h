@@ -7,19 +7,46 @@
 #define NUM_PARTICLES 5000
 #define PARTICLE_RADIUS 4.0f
 #define GRAVITY -981.0f
+#define COLLISION_RESPONSE 0.75f // Fraction of the overlap removed per substep
+#define CONTAINER_RESPONSE 0.75f // Share of the velocity kept when bouncing off a wall
 #define CONTAINER_SIZE 400
 #define CONTAINER_BORDER_WIDTH 0
+#define CONTAINER_PERIOD (2 * (CONTAINER_SIZE - CONTAINER_BORDER_WIDTH)) // Interior width of the box
 
 #define GRID_CELL_SIZE (2 * PARTICLE_RADIUS)
 #define GRID_WIDTH ((int)(WINDOW_WIDTH / GRID_CELL_SIZE) + 2)
 #define GRID_HEIGHT ((int)(WINDOW_HEIGHT / GRID_CELL_SIZE) + 2)
 #define MAX_PARTICLES_PER_CELL 100 // Adjust as necessary
 
+#define AMBIENT_TEMPERATURE 20.0f
+#define HEAT_CONDUCTIVITY 0.05f // Share of the temperature gap exchanged per contact per substep
+
+// Container walls for heat sources and sinks
+#define WALL_LEFT 0
+#define WALL_RIGHT 1
+#define WALL_BOTTOM 2
+#define WALL_TOP 3
+#define NUM_WALLS 4
+
+// Block time stepping: the world is split into square regions, and each
+// region steps every 2^level substeps, level in [0, MAX_TIME_LEVEL]
+#define TIME_REGION_SIZE 64
+#define TIME_REGION_WIDTH (WINDOW_WIDTH / TIME_REGION_SIZE + 2)
+#define TIME_REGION_HEIGHT (WINDOW_HEIGHT / TIME_REGION_SIZE + 2)
+#define MAX_TIME_LEVEL 2 // Higher levels trade stacking stiffness for speed
+#define TIME_BLOCK_SUBSTEPS (1 << MAX_TIME_LEVEL) // Substep counts must be a multiple of this
+
+// Sources of gravity for stepPhysicsWorld
+#define GRAVITY_UNIFORM 0
+#define GRAVITY_BARNES_HUT 1
+#define GRAVITY_PARTICLE_MESH 2
+
 typedef struct {
     mfloat_t curr_position[VEC2_SIZE];
     mfloat_t old_position[VEC2_SIZE];
     mfloat_t acceleration[VEC2_SIZE];
     mfloat_t radius;
+    mfloat_t temperature;
 } Particle;
 
 typedef struct {
@@ -27,12 +54,188 @@ typedef struct {
     int particle_indices[MAX_PARTICLES_PER_CELL];
 } GridCell;
 
-extern Particle particles[NUM_PARTICLES];
+// Optional subsystems keep their state in the world, allocated the first
+// time the subsystem is used
+struct LinkSet;
+struct SoftBodySet;
+struct RigidClusterSet;
+struct StaticColliders;
+struct SignedDistanceField;
+struct SphState;
+struct PairTable;
+struct BarnesHutTree;
+struct ParticleMesh;
+struct EventStream;
+struct ToolState;
+struct TileMap;
+
+// One independent simulation. Everything a step reads or writes lives
+// here, so separate worlds can be stepped concurrently.
+typedef struct PhysicsWorld {
+    Particle particles[NUM_PARTICLES];
+    int active_particles; // Particles [0, active_particles) are simulated
+
+    // Scene settings used by stepPhysicsWorld
+    int container; // box = 0, circle = 1, signed distance field = 2, periodic box = 3
+    mfloat_t container_pos[VEC2_SIZE];
+    bool periodic[VEC2_SIZE]; // Axes of the periodic box that wrap; the others keep their walls
+    mfloat_t gravity; // Vertical acceleration of GRAVITY_UNIFORM
+    mfloat_t collision_response; // Share of each overlap removed per substep
+    mfloat_t container_response; // Share of the velocity kept when bouncing off a wall
+    int gravity_mode;
+    int mesh_boundary; // PmBoundary used by GRAVITY_PARTICLE_MESH
+    mfloat_t nbody_theta; // Barnes-Hut opening angle
+    bool block_timesteps; // Step quiet regions every 2, 4, ... substeps
+    mfloat_t substep_cfl; // Max fraction of a radius a particle may move per substep
+
+    // Temperature each wall drives touching particles towards, and the
+    // share of the gap closed per substep of contact (0 = insulated).
+    // Circle containers use the bottom wall for their lower half and the
+    // top wall for the rest.
+    mfloat_t wall_temperature[NUM_WALLS];
+    mfloat_t wall_heat_transfer[NUM_WALLS];
+
+    GridCell* grid; // GRID_WIDTH * GRID_HEIGHT cells, column by column
+
+    // Neighbour lists in compressed form: the neighbours of particle i are
+    // neighbor_indices[neighbor_offsets[i]] .. neighbor_indices[neighbor_offsets[i + 1] - 1]
+    // and include i itself
+    int neighbor_offsets[NUM_PARTICLES + 1];
+    int* neighbor_indices;
+    int neighbor_capacity;
+
+    // Block time stepping state
+    bool time_levels_enabled;
+    int current_substep;
+    unsigned char particle_level[NUM_PARTICLES];
+    unsigned char region_level[TIME_REGION_WIDTH][TIME_REGION_HEIGHT];
+    unsigned char region_due[TIME_REGION_WIDTH][TIME_REGION_HEIGHT];
+    unsigned char region_near_due[TIME_REGION_WIDTH][TIME_REGION_HEIGHT];
+
+    // Links, soft bodies and rigid clusters holding each slot. They refer
+    // to particles by slot, so removeParticle refuses to move these.
+    int constraint_refs[NUM_PARTICLES];
+
+    struct LinkSet* links;
+    struct SoftBodySet* soft_bodies;
+    struct RigidClusterSet* rigid_clusters;
+    struct StaticColliders* colliders;
+    struct SignedDistanceField* sdf;
+    struct SphState* sph;
+    struct PairTable* pairs;
+    struct BarnesHutTree* nbody;
+    struct ParticleMesh* mesh;
+    struct EventStream* events;
+    struct ToolState* tools;
+    struct TileMap* tiles;
+    struct CollisionLayers* layers;
+} PhysicsWorld;
+
+// Creates an empty world with a box container centred in the window and
+// uniform gravity. Returns NULL if memory runs out.
+PhysicsWorld* createPhysicsWorld(void);
+// Frees the world and every subsystem state it owns
+void destroyPhysicsWorld(PhysicsWorld* world);
+// Advances the world by dt split into substeps, running every subsystem
+// that has been set up
+void stepPhysicsWorld(PhysicsWorld* world, float dt, int substeps);
+
+// Resets the per-particle state subsystems keep outside Particle (species,
+// fluid flag, collision layers, time level, rest offset) for slot idx.
+// Call whenever a slot is filled with a new particle.
+void initParticleSlot(PhysicsWorld* world, int idx);
+// Removes active particle idx by moving the last active particle, with its
+// per-particle state, into the slot. Grabbed particles and recorded
+// collision events follow the move.
+// Constraints refer to particles by index, so returns -1 and leaves the
+// world unchanged when idx or the last active particle is constrained.
+int removeParticle(PhysicsWorld* world, int idx);
+// True if a link, soft body or rigid cluster holds slot idx
+bool isParticleConstrained(const PhysicsWorld* world, int idx);
+
+// The part of a particle's per-slot state that belongs to the particle
+// rather than to the step, for saving it and restoring it into any slot
+typedef struct {
+    unsigned char species;
+    unsigned char fluid;
+    unsigned int category; // Collision layers
+    unsigned int mask;
+} ParticleTraits;
+void getParticleTraits(const PhysicsWorld* world, int idx, ParticleTraits* traits);
+// Fills slot idx like initParticleSlot, then applies traits
+void setParticleTraits(PhysicsWorld* world, int idx, const ParticleTraits* traits);
+
+void updateParticlePositions(PhysicsWorld* world, float dt);
+void applyGravity(PhysicsWorld* world);
+void applyContainerConstraints(PhysicsWorld* world);
+// Switches to the periodic box container. Particles leaving through a
+// wrapped side re-enter through the opposite one, and contacts across it
+// use the nearest periodic image. The wrapped sides must lie on grid
+// lines, as they do for the default centred box. Returns -1 otherwise.
+int setPeriodicBoundaries(PhysicsWorld* world, bool wrapX, bool wrapY);
+// Period along axis when the periodic box wraps it, 0 otherwise
+mfloat_t periodicWrap(const PhysicsWorld* world, int axis);
+// Separation along one axis to the nearest periodic image, for a wrap from
+// periodicWrap. A wrap of 0 returns d unchanged, so kernels can apply it
+// without branching on the container.
+static inline mfloat_t wrapSeparation(mfloat_t d, mfloat_t wrap) {
+    return d - wrap * (mfloat_t)((d > 0.5f * wrap) - (d < -0.5f * wrap));
+}
+void detectCollisions(PhysicsWorld* world);
+
+// Buckets the active particles into the uniform grid
+void populateGrid(PhysicsWorld* world);
+// Adds one particle to the current grid, e.g. right after spawning it
+void insertIntoGrid(PhysicsWorld* world, int p_idx);
+
+// Rebuilds the grid and gathers, for every active particle, all particles
+// closer than radius. Returns the total number of entries, or -1 on failure.
+// In the periodic box distances are to the nearest image, so radius should
+// stay under half a period.
+int buildNeighborLists(PhysicsWorld* world, mfloat_t radius);
+void fixCollisions(PhysicsWorld* world, Particle* p1, Particle* p2);
+
+// Spatial queries over the collision grid. They only read the world's grid
+// and particles, so any number of threads may run them between steps. The
+// grid is the one built during the last substep; the search is widened to
+// cover motion since then and current positions are tested. Radius and box
+// queries match particle centers and return the total number of matches,
+// writing at most maxResults indices. They see across the wrapped sides of
+// the periodic box; raycasts do not.
+int queryRadius(const PhysicsWorld* world, const mfloat_t* center, mfloat_t radius, int* results, int maxResults);
+int queryAabb(const PhysicsWorld* world, const mfloat_t* min, const mfloat_t* max, int* results, int maxResults);
+// Returns the first particle whose circle the segment from start to end
+// touches, or -1. hitFraction (may be NULL) receives the hit position along
+// the segment in [0, 1].
+int raycastParticles(const PhysicsWorld* world, const mfloat_t* start, const mfloat_t* end, mfloat_t* hitFraction);
+
+// Enables block time stepping for the current step. Each region gets the
+// largest power-of-two level that keeps its fastest particle under
+// maxDisplacement per (enlarged) step; neighbouring regions differ by at
+// most one level. Call at the start of a step, when every particle is
+// synchronized, with a substep count that is a multiple of
+// TIME_BLOCK_SUBSTEPS.
+void assignTimeLevels(PhysicsWorld* world, mfloat_t maxDisplacement);
+// Turns block time stepping off, returning every particle to level 0
+void clearTimeLevels(PhysicsWorld* world);
+// Marks which regions are due on this substep (0-based within the step).
+// Regions that are not due skip integration, and cells whose whole
+// neighbourhood is not due skip collision detection.
+void beginTimeBlockSubstep(PhysicsWorld* world, int substep);
+
+// Largest distance any active particle moved during the last substep
+mfloat_t maxParticleDisplacement(const PhysicsWorld* world);
+
+// Scales every particle's implicit Verlet velocity (curr - old) by factor.
+// Needed whenever the substep length changes between steps.
+void rescaleVelocities(PhysicsWorld* world, mfloat_t factor);
 
-void updateParticlePositions(int activeParticles, float dt);
-void applyGravity(int activeParticles);
-void applyContainerConstraints(int activeParticles, mfloat_t* containerPos, int container);
-void detectCollisions(int activeParticles);
-void fixCollisions(Particle* p1, Particle* p2);
+// Picks a substep count so that no particle is expected to move more than
+// cflFraction of its radius per substep over the next frame of length dt,
+// clamped to [minSubsteps, maxSubsteps].
+// prevSubDt is the substep length of the last frame, which converts the
+// stored displacements into speeds.
+int computeAdaptiveSubsteps(const PhysicsWorld* world, float dt, float prevSubDt,
+                            int minSubsteps, int maxSubsteps, mfloat_t cflFraction);
 
 #endif
\ No newline at end of file
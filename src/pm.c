@@ -0,0 +1,276 @@
+#include "pm.h"
+#include "nbody.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Isolated boundaries convolve on a mesh of twice the size so the
+// periodic FFT does not wrap mass from one edge onto the other
+#define PM_PADDED_WIDTH (2 * PM_MESH_WIDTH)
+#define PM_PADDED_HEIGHT (2 * PM_MESH_HEIGHT)
+#define PM_PADDED_CELLS (PM_PADDED_WIDTH * PM_PADDED_HEIGHT)
+#define PM_FFT_MAX PM_PADDED_WIDTH
+#define PM_CELL_WIDTH ((mfloat_t)WINDOW_WIDTH / PM_MESH_WIDTH)
+#define PM_CELL_HEIGHT ((mfloat_t)WINDOW_HEIGHT / PM_MESH_HEIGHT)
+
+typedef struct ParticleMesh {
+    // Work mesh, row-major with a row stride equal to the current FFT width
+    mfloat_t mesh_re[PM_PADDED_CELLS];
+    mfloat_t mesh_im[PM_PADDED_CELLS];
+
+    // Transformed Green's function, already divided by the inverse FFT scale
+    mfloat_t kernel_re[PM_PADDED_CELLS];
+    mfloat_t kernel_im[PM_PADDED_CELLS];
+    int kernel_boundary;
+
+    mfloat_t accel_x[PM_MESH_WIDTH * PM_MESH_HEIGHT];
+    mfloat_t accel_y[PM_MESH_WIDTH * PM_MESH_HEIGHT];
+
+    mfloat_t twiddle_re[PM_FFT_MAX / 2];
+    mfloat_t twiddle_im[PM_FFT_MAX / 2];
+} ParticleMesh;
+
+// Allocates the world's mesh and twiddle tables on first use
+static ParticleMesh* worldMesh(PhysicsWorld* world) {
+    if (!world->mesh) {
+        ParticleMesh* pm = (ParticleMesh*)malloc(sizeof(ParticleMesh));
+        if (!pm) {
+            fprintf(stderr, "Failed to allocate memory for the particle mesh\n");
+            return NULL;
+        }
+        pm->kernel_boundary = -1;
+        for (int k = 0; k < PM_FFT_MAX / 2; k++) {
+            mfloat_t angle = -2.0f * MPI * k / PM_FFT_MAX;
+            pm->twiddle_re[k] = MCOS(angle);
+            pm->twiddle_im[k] = MSIN(angle);
+        }
+        world->mesh = pm;
+    }
+    return world->mesh;
+}
+
+// In-place iterative radix-2 FFT of length n (a power of two <= PM_FFT_MAX).
+// The inverse is unnormalized.
+static void fft(const ParticleMesh* pm, mfloat_t* re, mfloat_t* im, int n, int inverse) {
+    const mfloat_t* twiddle_re = pm->twiddle_re;
+    const mfloat_t* twiddle_im = pm->twiddle_im;
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            mfloat_t t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2;
+        int step = PM_FFT_MAX / len;
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < half; k++) {
+                mfloat_t wr = twiddle_re[k * step];
+                mfloat_t wi = inverse ? -twiddle_im[k * step] : twiddle_im[k * step];
+                int a = i + k;
+                int b = a + half;
+                mfloat_t tr = re[b] * wr - im[b] * wi;
+                mfloat_t ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+static void fft2d(const ParticleMesh* pm, mfloat_t* re, mfloat_t* im, int width, int height, int inverse) {
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        fft(pm, &re[y * width], &im[y * width], width, inverse);
+    }
+
+    // Columns are gathered into contiguous scratch so the butterflies stay
+    // unit-stride
+    #pragma omp parallel for schedule(static)
+    for (int x = 0; x < width; x++) {
+        mfloat_t col_re[PM_FFT_MAX];
+        mfloat_t col_im[PM_FFT_MAX];
+        for (int y = 0; y < height; y++) {
+            col_re[y] = re[y * width + x];
+            col_im[y] = im[y * width + x];
+        }
+        fft(pm, col_re, col_im, height, inverse);
+        for (int y = 0; y < height; y++) {
+            re[y * width + x] = col_re[y];
+            im[y * width + x] = col_im[y];
+        }
+    }
+}
+
+// Signed offset in cells for FFT index i: periodic meshes use the minimum
+// image, padded meshes treat the upper half as negative offsets
+static inline int kernelOffset(int i, int n, PmBoundary boundary) {
+    if (boundary == PM_PERIODIC) {
+        return i <= n / 2 ? i : i - n;
+    }
+    return i < n / 2 ? i : i - n;
+}
+
+// Samples the potential of a unit mass, -G / sqrt(r^2 + eps^2), at every
+// mesh offset and transforms it. The Plummer kernel matches the force law
+// of the Barnes-Hut solver.
+static void buildKernel(ParticleMesh* pm, int width, int height, PmBoundary boundary) {
+    mfloat_t* kernel_re = pm->kernel_re;
+    mfloat_t* kernel_im = pm->kernel_im;
+    const mfloat_t softening_sq = NBODY_SOFTENING * NBODY_SOFTENING;
+    const mfloat_t scale = 1.0f / (width * height);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        mfloat_t dy = kernelOffset(y, height, boundary) * PM_CELL_HEIGHT;
+        for (int x = 0; x < width; x++) {
+            mfloat_t dx = kernelOffset(x, width, boundary) * PM_CELL_WIDTH;
+            kernel_re[y * width + x] = -NBODY_G * scale / MSQRT(dx * dx + dy * dy + softening_sq);
+            kernel_im[y * width + x] = 0.0f;
+        }
+    }
+    fft2d(pm, kernel_re, kernel_im, width, height, 0);
+    pm->kernel_boundary = boundary;
+}
+
+// Cloud-in-cell stencil along one axis. Cell centers sit at (i + 0.5) * cell.
+static inline void cicAxis(mfloat_t pos, mfloat_t cell, int n, PmBoundary boundary,
+                           int* i0, int* i1, mfloat_t* frac) {
+    mfloat_t u = pos / cell - 0.5f;
+    if (boundary == PM_PERIODIC) {
+        u -= n * MFLOOR(u / n);
+    } else {
+        u = MFMIN(MFMAX(u, 0.0f), n - 1.001f);
+    }
+    int i = (int)MFLOOR(u);
+    *frac = u - i;
+    *i0 = i % n;
+    *i1 = (i + 1) % n;
+}
+
+static void depositMass(ParticleMesh* pm, const Particle* particles, int activeParticles,
+                        int width, int height, PmBoundary boundary) {
+    mfloat_t* mesh_re = pm->mesh_re;
+    mfloat_t* mesh_im = pm->mesh_im;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < width * height; i++) {
+        mesh_re[i] = 0.0f;
+        mesh_im[i] = 0.0f;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < activeParticles; i++) {
+        int x0, x1, y0, y1;
+        mfloat_t fx, fy;
+        cicAxis(particles[i].curr_position[0], PM_CELL_WIDTH, PM_MESH_WIDTH, boundary, &x0, &x1, &fx);
+        cicAxis(particles[i].curr_position[1], PM_CELL_HEIGHT, PM_MESH_HEIGHT, boundary, &y0, &y1, &fy);
+        #pragma omp atomic
+        mesh_re[y0 * width + x0] += (1.0f - fx) * (1.0f - fy);
+        #pragma omp atomic
+        mesh_re[y0 * width + x1] += fx * (1.0f - fy);
+        #pragma omp atomic
+        mesh_re[y1 * width + x0] += (1.0f - fx) * fy;
+        #pragma omp atomic
+        mesh_re[y1 * width + x1] += fx * fy;
+    }
+}
+
+// Central differences of the potential; isolated meshes fall back to
+// one-sided differences at the window edges
+static void computeMeshAcceleration(ParticleMesh* pm, int width, PmBoundary boundary) {
+    const mfloat_t* mesh_re = pm->mesh_re;
+    mfloat_t* accel_x = pm->accel_x;
+    mfloat_t* accel_y = pm->accel_y;
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < PM_MESH_HEIGHT; y++) {
+        int down = y - 1;
+        int up = y + 1;
+        if (boundary == PM_PERIODIC) {
+            down = (down + PM_MESH_HEIGHT) % PM_MESH_HEIGHT;
+            up = up % PM_MESH_HEIGHT;
+        } else {
+            down = down < 0 ? 0 : down;
+            up = up >= PM_MESH_HEIGHT ? PM_MESH_HEIGHT - 1 : up;
+        }
+        mfloat_t dy_span = (boundary == PM_PERIODIC ? 2 : up - down) * PM_CELL_HEIGHT;
+
+        for (int x = 0; x < PM_MESH_WIDTH; x++) {
+            int left = x - 1;
+            int right = x + 1;
+            if (boundary == PM_PERIODIC) {
+                left = (left + PM_MESH_WIDTH) % PM_MESH_WIDTH;
+                right = right % PM_MESH_WIDTH;
+            } else {
+                left = left < 0 ? 0 : left;
+                right = right >= PM_MESH_WIDTH ? PM_MESH_WIDTH - 1 : right;
+            }
+            mfloat_t dx_span = (boundary == PM_PERIODIC ? 2 : right - left) * PM_CELL_WIDTH;
+
+            accel_x[y * PM_MESH_WIDTH + x] = -(mesh_re[y * width + right] - mesh_re[y * width + left]) / dx_span;
+            accel_y[y * PM_MESH_WIDTH + x] = -(mesh_re[up * width + x] - mesh_re[down * width + x]) / dy_span;
+        }
+    }
+}
+
+void applyMeshGravity(PhysicsWorld* world, PmBoundary boundary) {
+    const int activeParticles = world->active_particles;
+    if (activeParticles < 1) return;
+    ParticleMesh* pm = worldMesh(world);
+    if (!pm) return;
+
+    int width = boundary == PM_PERIODIC ? PM_MESH_WIDTH : PM_PADDED_WIDTH;
+    int height = boundary == PM_PERIODIC ? PM_MESH_HEIGHT : PM_PADDED_HEIGHT;
+    if (pm->kernel_boundary != (int)boundary) {
+        buildKernel(pm, width, height, boundary);
+    }
+
+    // Convolve the density with the Green's function in frequency space
+    Particle* particles = world->particles;
+    mfloat_t* mesh_re = pm->mesh_re;
+    mfloat_t* mesh_im = pm->mesh_im;
+    const mfloat_t* kernel_re = pm->kernel_re;
+    const mfloat_t* kernel_im = pm->kernel_im;
+    depositMass(pm, particles, activeParticles, width, height, boundary);
+    fft2d(pm, mesh_re, mesh_im, width, height, 0);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < width * height; i++) {
+        mfloat_t re = mesh_re[i] * kernel_re[i] - mesh_im[i] * kernel_im[i];
+        mfloat_t im = mesh_re[i] * kernel_im[i] + mesh_im[i] * kernel_re[i];
+        mesh_re[i] = re;
+        mesh_im[i] = im;
+    }
+    fft2d(pm, mesh_re, mesh_im, width, height, 1);
+
+    computeMeshAcceleration(pm, width, boundary);
+    const mfloat_t* accel_x = pm->accel_x;
+    const mfloat_t* accel_y = pm->accel_y;
+
+    // Gather with the same stencil used for the deposit so particles feel
+    // no self-force
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < activeParticles; i++) {
+        Particle* p = &particles[i];
+        int x0, x1, y0, y1;
+        mfloat_t fx, fy;
+        cicAxis(p->curr_position[0], PM_CELL_WIDTH, PM_MESH_WIDTH, boundary, &x0, &x1, &fx);
+        cicAxis(p->curr_position[1], PM_CELL_HEIGHT, PM_MESH_HEIGHT, boundary, &y0, &y1, &fy);
+        mfloat_t w00 = (1.0f - fx) * (1.0f - fy);
+        mfloat_t w10 = fx * (1.0f - fy);
+        mfloat_t w01 = (1.0f - fx) * fy;
+        mfloat_t w11 = fx * fy;
+        p->acceleration[0] += w00 * accel_x[y0 * PM_MESH_WIDTH + x0] + w10 * accel_x[y0 * PM_MESH_WIDTH + x1]
+                            + w01 * accel_x[y1 * PM_MESH_WIDTH + x0] + w11 * accel_x[y1 * PM_MESH_WIDTH + x1];
+        p->acceleration[1] += w00 * accel_y[y0 * PM_MESH_WIDTH + x0] + w10 * accel_y[y0 * PM_MESH_WIDTH + x1]
+                            + w01 * accel_y[y1 * PM_MESH_WIDTH + x0] + w11 * accel_y[y1 * PM_MESH_WIDTH + x1];
+    }
+}
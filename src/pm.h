@@ -0,0 +1,25 @@
+#ifndef PM_H
+#define PM_H
+
+#include "mathc.h"
+#include "physics.h"
+
+// The mesh covers the window. Both sizes must be powers of two and the
+// height may not exceed the width.
+#define PM_MESH_WIDTH 128
+#define PM_MESH_HEIGHT 64
+
+typedef enum {
+    PM_PERIODIC, // The window wraps around in both axes
+    PM_ISOLATED  // No mass outside the window; the mesh is zero-padded
+} PmBoundary;
+
+// Deposits the active particles onto the mesh with cloud-in-cell weights,
+// solves for the potential with an FFT convolution and adds the
+// interpolated acceleration to every particle. Uses the same softened
+// force law and constants as applyMutualGravity, so the two solvers can be
+// benchmarked against each other. Structure smaller than about two mesh
+// cells is smoothed out, so the mesh suits dense, roughly uniform scenes.
+void applyMeshGravity(PhysicsWorld* world, PmBoundary boundary);
+
+#endif
@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -23,28 +24,39 @@ const char* particleVertexShaderSource =
 "#version 330 core\n"
 "layout(location = 0) in vec2 aPosition;\n"
 "layout(location = 1) in vec2 aVelocity;\n"
+"layout(location = 2) in float aTemperature;\n"
 "uniform float uRadius;\n"
 "uniform mat4 uProjection;\n"
 "out vec2 vVelocity;\n"
+"out float vTemperature;\n"
 "void main()\n"
 "{\n"
 "    gl_Position = uProjection * vec4(aPosition, 0.0, 1.0);\n"
 "    gl_PointSize = uRadius * 2.0;\n"
 "    vVelocity = aVelocity;\n"
+"    vTemperature = aTemperature;\n"
 "}\n";
 
 const char* particleFragmentShaderSource = 
 "#version 330 core\n"
 "in vec2 vVelocity;\n"
+"in float vTemperature;\n"
 "out vec4 FragColor;\n"
 "uniform vec3 uColor;\n"
-"uniform bool uColorMode;\n"
+"uniform int uColorMode;\n"
+"uniform vec2 uTemperatureRange;\n"
 "void main()\n"
 "{\n"
 "    vec2 coord = gl_PointCoord - vec2(0.5);\n"
 "    if (length(coord) > 2.0)\n"
 "        discard;\n"
-"    if (uColorMode)\n"
+"    if (uColorMode == 2)\n"
+"    {\n"
+"        float t = clamp((vTemperature - uTemperatureRange.x) / (uTemperatureRange.y - uTemperatureRange.x), 0.0, 1.0);\n"
+"        vec3 cold = mix(vec3(0.1, 0.2, 1.0), vec3(1.0, 1.0, 1.0), clamp(t * 2.0, 0.0, 1.0));\n"
+"        FragColor = vec4(mix(cold, vec3(1.0, 0.15, 0.0), clamp(t * 2.0 - 1.0, 0.0, 1.0)), 1.0);\n"
+"    }\n"
+"    else if (uColorMode == 1)\n"
 "    {\n"
 "        float speed = length(vVelocity);\n"
 "        float maxSpeed = 100.0;\n"
@@ -81,6 +93,7 @@ const char* containerFragmentShaderSource =
 static GLuint particleShaderProgram;
 static GLuint containerShaderProgram;
 static GLuint particleVBO;
+static GLuint particleStateVBO;
 static GLuint particleVAO;
 
 static GLuint compile_shader(GLenum type, const char* source) {
@@ -187,6 +200,14 @@ void init_renderer(int window_width, int window_height) {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
 
+    // Temperature attribute (location 2) reads straight out of the uploaded
+    // particle structs, so no CPU pass is needed to gather it
+    glGenBuffers(1, &particleStateVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, particleStateVBO);
+    glBufferData(GL_ARRAY_BUFFER, NUM_PARTICLES * sizeof(Particle), NULL, GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, temperature));
+
     // Unbind VAO and VBO
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -325,11 +346,34 @@ void draw_container(mfloat_t* containerPos, int containerType) {
     glUseProgram(0);
 }
 
-void draw_particles(int activeParticles, float* data, bool colorByVelocity) {
+void draw_segments(const float* vertices, int numSegments) {
+    if (numSegments <= 0) return;
+
+    glUseProgram(containerShaderProgram);
+    glBindVertexArray(0);
+
+    GLuint segmentVBO;
+    glGenBuffers(1, &segmentVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, segmentVBO);
+    glBufferData(GL_ARRAY_BUFFER, numSegments * 4 * sizeof(GLfloat), vertices, GL_STREAM_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+
+    glDrawArrays(GL_LINES, 0, numSegments * 2);
+
+    glDisableVertexAttribArray(0);
+    glDeleteBuffers(1, &segmentVBO);
+
+    glUseProgram(0);
+}
+
+void draw_particles(int activeParticles, float* data, const void* particleStates, int colorMode) {
     GL_CHECK(glUseProgram(particleShaderProgram));
 
     // Set uColorMode uniform
-    glUniform1i(glGetUniformLocation(particleShaderProgram, "uColorMode"), colorByVelocity ? 1 : 0);
+    glUniform1i(glGetUniformLocation(particleShaderProgram, "uColorMode"), colorMode);
+    glUniform2f(glGetUniformLocation(particleShaderProgram, "uTemperatureRange"), TEMPERATURE_COLOR_MIN, TEMPERATURE_COLOR_MAX);
 
     // Set radius uniform (in case it was changed)
     glUniform1f(glGetUniformLocation(particleShaderProgram, "uRadius"), PARTICLE_RADIUS);
@@ -339,8 +383,8 @@ void draw_particles(int activeParticles, float* data, bool colorByVelocity) {
     ortho(0.0f, (float)WINDOW_WIDTH, 0.0f, (float)WINDOW_HEIGHT, -1.0f, 1.0f, projection);
     glUniformMatrix4fv(glGetUniformLocation(particleShaderProgram, "uProjection"), 1, GL_FALSE, projection);
 
-    // Set default color if not coloring by velocity
-    if (!colorByVelocity) {
+    // Set default color for solid coloring
+    if (colorMode == COLOR_MODE_SOLID) {
         glUniform3f(glGetUniformLocation(particleShaderProgram, "uColor"), 0.5f, 0.8f, 1.f); // Light blue
     }
 
@@ -350,6 +394,11 @@ void draw_particles(int activeParticles, float* data, bool colorByVelocity) {
     glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
     glBufferSubData(GL_ARRAY_BUFFER, 0, activeParticles * 4 * sizeof(float), data);
 
+    if (colorMode == COLOR_MODE_TEMPERATURE) {
+        glBindBuffer(GL_ARRAY_BUFFER, particleStateVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, activeParticles * sizeof(Particle), particleStates);
+    }
+
     // Draw particles
     glDrawArrays(GL_POINTS, 0, activeParticles);
 
@@ -376,6 +425,7 @@ void update_projection(int window_width, int window_height) {
 
 void cleanup_renderer() {
     glDeleteBuffers(1, &particleVBO);
+    glDeleteBuffers(1, &particleStateVBO);
     glDeleteVertexArrays(1, &particleVAO);
     glDeleteProgram(particleShaderProgram);
     glDeleteProgram(containerShaderProgram);
@@ -6,15 +6,29 @@
 #define WINDOW_WIDTH 1536
 #define WINDOW_HEIGHT 864
 
+#define COLOR_MODE_SOLID 0
+#define COLOR_MODE_VELOCITY 1
+#define COLOR_MODE_TEMPERATURE 2
+
+// Temperatures mapped to the cold and hot ends of the temperature colormap
+#define TEMPERATURE_COLOR_MIN 0.0f
+#define TEMPERATURE_COLOR_MAX 100.0f
+
 void draw_container(mfloat_t* containerPos, int container);
 
+// Draws line segments using the container shader
+// vertices: (ax, ay, bx, by) for each segment
+void draw_segments(const float* vertices, int numSegments);
+
 // Initializes the renderer with the given window dimensions
 void init_renderer(int window_width, int window_height);
 
 // Draws particles using point primitives
 // activeParticles: Number of active particles to render
-// positions: Array of positions (x, y) for each active particle
-void draw_particles(int activeParticles, float* data, bool colorByVelocity);
+// data: Positions and velocities (x, y, vx, vy) for each active particle
+// particleStates: The world's Particle array, read by COLOR_MODE_TEMPERATURE
+// colorMode: One of the COLOR_MODE_* values
+void draw_particles(int activeParticles, float* data, const void* particleStates, int colorMode);
 
 // Cleans up renderer resources
 void cleanup_renderer();
@@ -0,0 +1,158 @@
+#include "rigidbody.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocates the world's rigid cluster set on first use
+static RigidClusterSet* worldRigidClusters(PhysicsWorld* world) {
+    if (!world->rigid_clusters) {
+        world->rigid_clusters = (RigidClusterSet*)calloc(1, sizeof(RigidClusterSet));
+        if (!world->rigid_clusters) {
+            fprintf(stderr, "Failed to allocate memory for rigid clusters\n");
+        }
+    }
+    return world->rigid_clusters;
+}
+
+// Checks that [firstParticle, firstParticle + numParticles) can hold a new
+// cluster: at least 2 particles, inside the particle array and sharing no
+// particle with an existing cluster
+static bool validClusterRange(const PhysicsWorld* world, int firstParticle, int numParticles) {
+    if (numParticles < 2 || firstParticle < 0 || firstParticle + numParticles > NUM_PARTICLES) {
+        return false;
+    }
+    const RigidClusterSet* clusters = world->rigid_clusters;
+    if (!clusters) return true;
+    for (int c = 0; c < clusters->num_rigid_clusters; c++) {
+        int offset = clusters->rigid_cluster_offset[c];
+        if (firstParticle < offset + clusters->rigid_cluster_count[c] && offset < firstParticle + numParticles) {
+            printf("Error: particles %d..%d overlap rigid cluster %d\n", firstParticle, firstParticle + numParticles - 1, c);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Position of particle k relative to particle offset, taking the nearest
+// periodic image so a cluster may straddle a wrapped side
+static inline void clusterPosition(const Particle* particles, int offset, int k, const mfloat_t* wrap, mfloat_t* out) {
+    out[0] = wrapSeparation(particles[k].curr_position[0] - particles[offset].curr_position[0], wrap[0]);
+    out[1] = wrapSeparation(particles[k].curr_position[1] - particles[offset].curr_position[1], wrap[1]);
+}
+
+int addRigidCluster(PhysicsWorld* world, int firstParticle, int numParticles, mfloat_t stiffness) {
+    RigidClusterSet* clusters = worldRigidClusters(world);
+    if (!clusters) return -1;
+    if (clusters->num_rigid_clusters >= MAX_RIGID_CLUSTERS) {
+        printf("Error: too many rigid clusters (max %d)\n", MAX_RIGID_CLUSTERS);
+        return -1;
+    }
+    // A shared particle would have two rest offsets
+    if (!validClusterRange(world, firstParticle, numParticles)) return -1;
+
+    const Particle* particles = world->particles;
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+    mfloat_t centroid[VEC2_SIZE] = {0.0f, 0.0f};
+    for (int k = firstParticle; k < firstParticle + numParticles; k++) {
+        clusterPosition(particles, firstParticle, k, wrap, clusters->rest_offset[k]);
+        vec2_add(centroid, centroid, clusters->rest_offset[k]);
+    }
+    vec2_divide_f(centroid, centroid, (mfloat_t)numParticles);
+    for (int k = firstParticle; k < firstParticle + numParticles; k++) {
+        vec2_subtract(clusters->rest_offset[k], clusters->rest_offset[k], centroid);
+    }
+
+    for (int k = 0; k < numParticles; k++) {
+        world->constraint_refs[firstParticle + k]++;
+    }
+    int c = clusters->num_rigid_clusters++;
+    clusters->rigid_cluster_offset[c] = firstParticle;
+    clusters->rigid_cluster_count[c] = numParticles;
+    clusters->rigid_cluster_stiffness[c] = stiffness;
+    return c;
+}
+
+int createRigidBox(PhysicsWorld* world, mfloat_t* center, int cols, int rows, mfloat_t angle, int firstParticle, mfloat_t stiffness) {
+    int numParticles = cols * rows;
+    // Leave the particles of an existing cluster where they are
+    if (!validClusterRange(world, firstParticle, numParticles)) return -1;
+
+    mfloat_t spacing = 2.0f * PARTICLE_RADIUS;
+    mfloat_t c = MCOS(angle);
+    mfloat_t s = MSIN(angle);
+    for (int j = 0; j < rows; j++) {
+        for (int i = 0; i < cols; i++) {
+            Particle* p = &world->particles[firstParticle + j * cols + i];
+            mfloat_t x = (i - (cols - 1) * 0.5f) * spacing;
+            mfloat_t y = (j - (rows - 1) * 0.5f) * spacing;
+            vec2(p->curr_position, center[0] + c * x - s * y, center[1] + s * x + c * y);
+            vec2_assign(p->old_position, p->curr_position);
+            vec2_zero(p->acceleration);
+            p->radius = PARTICLE_RADIUS;
+            p->temperature = AMBIENT_TEMPERATURE;
+        }
+    }
+    return addRigidCluster(world, firstParticle, numParticles, stiffness);
+}
+
+void clearRigidClusters(PhysicsWorld* world) {
+    RigidClusterSet* clusters = world->rigid_clusters;
+    if (!clusters) return;
+    for (int c = 0; c < clusters->num_rigid_clusters; c++) {
+        for (int k = 0; k < clusters->rigid_cluster_count[c]; k++) {
+            world->constraint_refs[clusters->rigid_cluster_offset[c] + k]--;
+        }
+    }
+    clusters->num_rigid_clusters = 0;
+}
+
+void solveRigidClusters(PhysicsWorld* world) {
+    RigidClusterSet* clusters = world->rigid_clusters;
+    if (!clusters) return;
+    Particle* particles = world->particles;
+    const mfloat_t (*rest_offset)[VEC2_SIZE] = (const mfloat_t (*)[VEC2_SIZE])clusters->rest_offset;
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    // Clusters own disjoint particle ranges, so each one is reduced and
+    // corrected independently
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < clusters->num_rigid_clusters; c++) {
+        int offset = clusters->rigid_cluster_offset[c];
+        int count = clusters->rigid_cluster_count[c];
+        if (offset + count > world->active_particles) continue;
+
+        // Centroid. Positions are taken relative to the first particle,
+        // which the corrections below move, so keep a copy of it.
+        const mfloat_t ax = particles[offset].curr_position[0];
+        const mfloat_t ay = particles[offset].curr_position[1];
+        mfloat_t cx = 0.0f;
+        mfloat_t cy = 0.0f;
+        for (int k = offset; k < offset + count; k++) {
+            cx += wrapSeparation(particles[k].curr_position[0] - ax, wrap[0]);
+            cy += wrapSeparation(particles[k].curr_position[1] - ay, wrap[1]);
+        }
+        cx /= count;
+        cy /= count;
+
+        // In 2D the rotation part of the covariance sum(p - c) * q^T reduces
+        // to the angle atan2(sum(q x p), sum(q . p))
+        mfloat_t dot = 0.0f;
+        mfloat_t cross = 0.0f;
+        for (int k = offset; k < offset + count; k++) {
+            mfloat_t px = wrapSeparation(particles[k].curr_position[0] - ax, wrap[0]) - cx;
+            mfloat_t py = wrapSeparation(particles[k].curr_position[1] - ay, wrap[1]) - cy;
+            dot += rest_offset[k][0] * px + rest_offset[k][1] * py;
+            cross += rest_offset[k][0] * py - rest_offset[k][1] * px;
+        }
+        mfloat_t norm = MSQRT(dot * dot + cross * cross) + MFLT_EPSILON;
+        mfloat_t cos_r = dot / norm;
+        mfloat_t sin_r = cross / norm;
+
+        mfloat_t stiffness = clusters->rigid_cluster_stiffness[c];
+        for (int k = offset; k < offset + count; k++) {
+            mfloat_t gx = cx + cos_r * rest_offset[k][0] - sin_r * rest_offset[k][1];
+            mfloat_t gy = cy + sin_r * rest_offset[k][0] + cos_r * rest_offset[k][1];
+            particles[k].curr_position[0] += stiffness * (gx - wrapSeparation(particles[k].curr_position[0] - ax, wrap[0]));
+            particles[k].curr_position[1] += stiffness * (gy - wrapSeparation(particles[k].curr_position[1] - ay, wrap[1]));
+        }
+    }
+}
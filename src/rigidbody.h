@@ -0,0 +1,41 @@
+#ifndef RIGIDBODY_H
+#define RIGIDBODY_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_RIGID_CLUSTERS 8192
+
+// A rigid cluster is a range of consecutive particles
+// [rigid_cluster_offset[c], rigid_cluster_offset[c] + rigid_cluster_count[c])
+// kept in its rest shape by shape matching. Cluster particles collide
+// through the regular particle grid. In the periodic box clusters are
+// measured through the nearest images, so they may straddle a wrapped side.
+typedef struct RigidClusterSet {
+    int rigid_cluster_offset[MAX_RIGID_CLUSTERS];
+    int rigid_cluster_count[MAX_RIGID_CLUSTERS];
+    mfloat_t rigid_cluster_stiffness[MAX_RIGID_CLUSTERS];
+    int num_rigid_clusters;
+
+    // Rest position of each clustered particle relative to its cluster centroid
+    mfloat_t rest_offset[NUM_PARTICLES][VEC2_SIZE];
+} RigidClusterSet;
+
+// Freezes the current layout of particles [firstParticle, firstParticle +
+// numParticles) as the rest shape of a new cluster. stiffness is in (0, 1],
+// where 1 snaps fully to the best-fit pose every substep.
+// Returns the cluster index, or -1 on failure, including when the range
+// shares a particle with an existing cluster.
+int addRigidCluster(PhysicsWorld* world, int firstParticle, int numParticles, mfloat_t stiffness);
+
+// Lays out a cols x rows block of touching particles centered on center,
+// rotated by angle, then calls addRigidCluster.
+int createRigidBox(PhysicsWorld* world, mfloat_t* center, int cols, int rows, mfloat_t angle, int firstParticle, mfloat_t stiffness);
+
+void clearRigidClusters(PhysicsWorld* world);
+
+// Finds the best-fit rotation and translation of every fully active cluster
+// and pulls its particles towards the matched rest shape.
+void solveRigidClusters(PhysicsWorld* world);
+
+#endif
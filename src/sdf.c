@@ -0,0 +1,175 @@
+#include "sdf.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SDF_FAR 1.0e6f
+
+static void fillSdf(SignedDistanceField* sdf) {
+    for (int y = 0; y < SDF_HEIGHT; y++) {
+        for (int x = 0; x < SDF_WIDTH; x++) {
+            sdf->sdf_phi[y][x] = SDF_FAR;
+        }
+    }
+}
+
+// Allocates the world's field on first use, starting as all free space
+static SignedDistanceField* worldSdf(PhysicsWorld* world) {
+    if (!world->sdf) {
+        world->sdf = (SignedDistanceField*)malloc(sizeof(SignedDistanceField));
+        if (!world->sdf) {
+            fprintf(stderr, "Failed to allocate memory for the signed distance field\n");
+            return NULL;
+        }
+        fillSdf(world->sdf);
+    }
+    return world->sdf;
+}
+
+void clearSdf(PhysicsWorld* world) {
+    SignedDistanceField* sdf = worldSdf(world);
+    if (sdf) fillSdf(sdf);
+}
+
+void addSdfPolygon(PhysicsWorld* world, const mfloat_t* vertices, int numVertices, bool solidInside) {
+    if (numVertices < 3) return;
+    SignedDistanceField* sdf = worldSdf(world);
+    if (!sdf) return;
+    float (*sdf_phi)[SDF_WIDTH] = sdf->sdf_phi;
+
+    // Exact distance to the nearest edge plus an even-odd inside test. This
+    // is O(nodes * edges) but only runs at load time.
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < SDF_HEIGHT; y++) {
+        mfloat_t py = (mfloat_t)(y * SDF_CELL_SIZE);
+        for (int x = 0; x < SDF_WIDTH; x++) {
+            mfloat_t px = (mfloat_t)(x * SDF_CELL_SIZE);
+            mfloat_t min_dist_sq = SDF_FAR;
+            bool inside = false;
+            for (int i = 0, j = numVertices - 1; i < numVertices; j = i++) {
+                mfloat_t ax = vertices[2 * j];
+                mfloat_t ay = vertices[2 * j + 1];
+                mfloat_t bx = vertices[2 * i];
+                mfloat_t by = vertices[2 * i + 1];
+                mfloat_t ex = bx - ax;
+                mfloat_t ey = by - ay;
+                mfloat_t t = ((px - ax) * ex + (py - ay) * ey) / (ex * ex + ey * ey + MFLT_EPSILON);
+                t = MFMIN(MFMAX(t, 0.0f), 1.0f);
+                mfloat_t dx = px - (ax + t * ex);
+                mfloat_t dy = py - (ay + t * ey);
+                min_dist_sq = MFMIN(min_dist_sq, dx * dx + dy * dy);
+                if ((ay > py) != (by > py) && px < ax + (py - ay) * ex / ey) {
+                    inside = !inside;
+                }
+            }
+            mfloat_t dist = MSQRT(min_dist_sq);
+            mfloat_t phi = (inside == solidInside) ? -dist : dist;
+            sdf_phi[y][x] = MFMIN(sdf_phi[y][x], (float)phi);
+        }
+    }
+}
+
+// Two-pass chamfer distance transform in node units. Seeds hold 0, every
+// other node starts at SDF_FAR.
+static void chamferTransform(float* dist, int width, int height) {
+    const float diagonal = 1.41421356f;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float d = dist[y * width + x];
+            if (x > 0) d = MFMIN(d, dist[y * width + x - 1] + 1.0f);
+            if (y > 0) {
+                d = MFMIN(d, dist[(y - 1) * width + x] + 1.0f);
+                if (x > 0) d = MFMIN(d, dist[(y - 1) * width + x - 1] + diagonal);
+                if (x < width - 1) d = MFMIN(d, dist[(y - 1) * width + x + 1] + diagonal);
+            }
+            dist[y * width + x] = d;
+        }
+    }
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = width - 1; x >= 0; x--) {
+            float d = dist[y * width + x];
+            if (x < width - 1) d = MFMIN(d, dist[y * width + x + 1] + 1.0f);
+            if (y < height - 1) {
+                d = MFMIN(d, dist[(y + 1) * width + x] + 1.0f);
+                if (x > 0) d = MFMIN(d, dist[(y + 1) * width + x - 1] + diagonal);
+                if (x < width - 1) d = MFMIN(d, dist[(y + 1) * width + x + 1] + diagonal);
+            }
+            dist[y * width + x] = d;
+        }
+    }
+}
+
+void addSdfMask(PhysicsWorld* world, const unsigned char* mask, int width, int height) {
+    SignedDistanceField* sdf = worldSdf(world);
+    if (!sdf) return;
+    float (*sdf_phi)[SDF_WIDTH] = sdf->sdf_phi;
+    const int num_nodes = SDF_WIDTH * SDF_HEIGHT;
+    float* to_solid = (float*)malloc(num_nodes * sizeof(float));
+    float* to_free = (float*)malloc(num_nodes * sizeof(float));
+    if (!to_solid || !to_free) {
+        fprintf(stderr, "Failed to allocate memory for the SDF mask transform\n");
+        free(to_solid);
+        free(to_free);
+        return;
+    }
+
+    // Nearest-sample the mask at every node
+    for (int y = 0; y < SDF_HEIGHT; y++) {
+        int my = y * height / SDF_HEIGHT;
+        for (int x = 0; x < SDF_WIDTH; x++) {
+            int mx = x * width / SDF_WIDTH;
+            bool solid = mask[my * width + mx] != 0;
+            to_solid[y * SDF_WIDTH + x] = solid ? 0.0f : SDF_FAR;
+            to_free[y * SDF_WIDTH + x] = solid ? SDF_FAR : 0.0f;
+        }
+    }
+    chamferTransform(to_solid, SDF_WIDTH, SDF_HEIGHT);
+    chamferTransform(to_free, SDF_WIDTH, SDF_HEIGHT);
+
+    // The surface sits halfway between a solid node and a free node
+    for (int y = 0; y < SDF_HEIGHT; y++) {
+        for (int x = 0; x < SDF_WIDTH; x++) {
+            int i = y * SDF_WIDTH + x;
+            float phi = (to_solid[i] > 0.0f) ? to_solid[i] - 0.5f : -(to_free[i] - 0.5f);
+            sdf_phi[y][x] = MFMIN(sdf_phi[y][x], phi * SDF_CELL_SIZE);
+        }
+    }
+
+    free(to_solid);
+    free(to_free);
+}
+
+mfloat_t sampleSdf(const SignedDistanceField* sdf, const mfloat_t* position, mfloat_t* gradient) {
+    const float (*sdf_phi)[SDF_WIDTH] = (const float (*)[SDF_WIDTH])sdf->sdf_phi;
+    mfloat_t gx = MFMIN(MFMAX(position[0] / SDF_CELL_SIZE, 0.0f), SDF_WIDTH - 1.001f);
+    mfloat_t gy = MFMIN(MFMAX(position[1] / SDF_CELL_SIZE, 0.0f), SDF_HEIGHT - 1.001f);
+    int x = (int)gx;
+    int y = (int)gy;
+    mfloat_t fx = gx - x;
+    mfloat_t fy = gy - y;
+
+    mfloat_t p00 = sdf_phi[y][x];
+    mfloat_t p10 = sdf_phi[y][x + 1];
+    mfloat_t p01 = sdf_phi[y + 1][x];
+    mfloat_t p11 = sdf_phi[y + 1][x + 1];
+
+    gradient[0] = ((p10 - p00) * (1.0f - fy) + (p11 - p01) * fy) / SDF_CELL_SIZE;
+    gradient[1] = ((p01 - p00) * (1.0f - fx) + (p11 - p10) * fx) / SDF_CELL_SIZE;
+    return (p00 * (1.0f - fx) + p10 * fx) * (1.0f - fy) + (p01 * (1.0f - fx) + p11 * fx) * fy;
+}
+
+void applySdfCollider(PhysicsWorld* world) {
+    const SignedDistanceField* sdf = world->sdf;
+    if (!sdf) return;
+    const int activeParticles = world->active_particles;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < activeParticles; i++) {
+        Particle* p = &world->particles[i];
+        mfloat_t gradient[VEC2_SIZE];
+        mfloat_t phi = sampleSdf(sdf, p->curr_position, gradient);
+        mfloat_t depth = MFMAX(p->radius - phi, 0.0f);
+        mfloat_t scale = depth / (MSQRT(gradient[0] * gradient[0] + gradient[1] * gradient[1]) + MFLT_EPSILON);
+        p->curr_position[0] += gradient[0] * scale;
+        p->curr_position[1] += gradient[1] * scale;
+    }
+}
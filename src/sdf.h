@@ -0,0 +1,37 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include "mathc.h"
+#include "renderer.h"
+#include "physics.h"
+
+#define SDF_CELL_SIZE 4
+#define SDF_WIDTH (WINDOW_WIDTH / SDF_CELL_SIZE + 1)
+#define SDF_HEIGHT (WINDOW_HEIGHT / SDF_CELL_SIZE + 1)
+
+typedef struct SignedDistanceField {
+    // Signed distance sampled at grid nodes (x * SDF_CELL_SIZE, y * SDF_CELL_SIZE).
+    // Positive values are free space, negative values are solid.
+    float sdf_phi[SDF_HEIGHT][SDF_WIDTH];
+} SignedDistanceField;
+
+// Resets the field so that the whole window is free space
+void clearSdf(PhysicsWorld* world);
+
+// Merges a closed polygon given as (x, y) pairs into the field. With
+// solidInside the polygon is an obstacle, otherwise it is a container and
+// everything outside it becomes solid. Shapes combine as a union of solids.
+void addSdfPolygon(PhysicsWorld* world, const mfloat_t* vertices, int numVertices, bool solidInside);
+
+// Merges an image mask (nonzero = solid) stretched over the whole window.
+// Row 0 of the mask is the bottom of the window.
+void addSdfMask(PhysicsWorld* world, const unsigned char* mask, int width, int height);
+
+// Bilinearly samples the distance and its gradient at a world position
+mfloat_t sampleSdf(const SignedDistanceField* sdf, const mfloat_t* position, mfloat_t* gradient);
+
+// Pushes every active particle whose distance is below its radius back
+// along the field gradient. Does nothing until a shape has been added.
+void applySdfCollider(PhysicsWorld* world);
+
+#endif
@@ -0,0 +1,174 @@
+#include "softbody.h"
+#include "constraints.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SOFT_BODY_AREA_STIFFNESS 0.5f
+
+// Allocates the world's soft body set on first use
+static SoftBodySet* worldSoftBodies(PhysicsWorld* world) {
+    if (!world->soft_bodies) {
+        world->soft_bodies = (SoftBodySet*)calloc(1, sizeof(SoftBodySet));
+        if (!world->soft_bodies) {
+            fprintf(stderr, "Failed to allocate memory for soft bodies\n");
+        }
+    }
+    return world->soft_bodies;
+}
+
+// Position of ring vertex k relative to the ring's first particle, taking
+// the nearest periodic image so a ring may straddle a wrapped side
+static inline void ringVertex(const Particle* particles, int offset, int k, const mfloat_t* wrap, mfloat_t* out) {
+    const mfloat_t* anchor = particles[offset].curr_position;
+    const mfloat_t* p = particles[offset + k].curr_position;
+    out[0] = wrapSeparation(p[0] - anchor[0], wrap[0]);
+    out[1] = wrapSeparation(p[1] - anchor[1], wrap[1]);
+}
+
+static mfloat_t ringArea(const PhysicsWorld* world, int offset, int count) {
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+    mfloat_t area = 0.0f;
+    for (int k = 0; k < count; k++) {
+        mfloat_t p[VEC2_SIZE];
+        mfloat_t q[VEC2_SIZE];
+        ringVertex(world->particles, offset, k, wrap, p);
+        ringVertex(world->particles, offset, (k + 1) % count, wrap, q);
+        area += p[0] * q[1] - q[0] * p[1];
+    }
+    return 0.5f * area;
+}
+
+// Checks that [firstParticle, firstParticle + numParticles) can hold a new
+// ring: at least 3 particles, inside the particle array and sharing no
+// particle with an existing body
+static bool validRing(const PhysicsWorld* world, int firstParticle, int numParticles) {
+    if (numParticles < 3 || firstParticle < 0 || firstParticle + numParticles > NUM_PARTICLES) {
+        return false;
+    }
+    const SoftBodySet* bodies = world->soft_bodies;
+    if (!bodies) return true;
+    for (int b = 0; b < bodies->num_soft_bodies; b++) {
+        int offset = bodies->soft_body_offset[b];
+        if (firstParticle < offset + bodies->soft_body_count[b] && offset < firstParticle + numParticles) {
+            printf("Error: particles %d..%d overlap soft body %d\n", firstParticle, firstParticle + numParticles - 1, b);
+            return false;
+        }
+    }
+    return true;
+}
+
+int addSoftBody(PhysicsWorld* world, int firstParticle, int numParticles, mfloat_t pressure, mfloat_t edgeStiffness) {
+    SoftBodySet* bodies = worldSoftBodies(world);
+    if (!bodies) return -1;
+    if (bodies->num_soft_bodies >= MAX_SOFT_BODIES) {
+        printf("Error: too many soft bodies (max %d)\n", MAX_SOFT_BODIES);
+        return -1;
+    }
+    if (!validRing(world, firstParticle, numParticles)) return -1;
+
+    for (int k = 0; k < numParticles; k++) {
+        int a = firstParticle + k;
+        int b = firstParticle + (k + 1) % numParticles;
+        if (addLink(world, a, b, -1.0f, edgeStiffness) < 0) return -1;
+    }
+
+    for (int k = 0; k < numParticles; k++) {
+        world->constraint_refs[firstParticle + k]++;
+    }
+    int b = bodies->num_soft_bodies++;
+    bodies->soft_body_offset[b] = firstParticle;
+    bodies->soft_body_count[b] = numParticles;
+    bodies->soft_body_pressure[b] = pressure;
+    bodies->soft_body_rest_area[b] = ringArea(world, firstParticle, numParticles) * pressure;
+    bodies->soft_body_stiffness[b] = SOFT_BODY_AREA_STIFFNESS;
+    return b;
+}
+
+int createSoftBody(PhysicsWorld* world, mfloat_t* center, mfloat_t radius, int firstParticle, int numParticles,
+                   mfloat_t pressure, mfloat_t edgeStiffness) {
+    // Leave the particles of an existing body where they are
+    if (!validRing(world, firstParticle, numParticles)) return -1;
+
+    // Counter-clockwise so the signed area is positive
+    for (int k = 0; k < numParticles; k++) {
+        Particle* p = &world->particles[firstParticle + k];
+        mfloat_t angle = 2.0f * MPI * k / numParticles;
+        vec2(p->curr_position, center[0] + MCOS(angle) * radius, center[1] + MSIN(angle) * radius);
+        vec2_assign(p->old_position, p->curr_position);
+        vec2_zero(p->acceleration);
+        p->radius = PARTICLE_RADIUS;
+        p->temperature = AMBIENT_TEMPERATURE;
+    }
+    return addSoftBody(world, firstParticle, numParticles, pressure, edgeStiffness);
+}
+
+void clearSoftBodies(PhysicsWorld* world) {
+    SoftBodySet* bodies = world->soft_bodies;
+    if (!bodies) return;
+    for (int b = 0; b < bodies->num_soft_bodies; b++) {
+        for (int k = 0; k < bodies->soft_body_count[b]; k++) {
+            world->constraint_refs[bodies->soft_body_offset[b] + k]--;
+        }
+    }
+    bodies->num_soft_bodies = 0;
+}
+
+void solveSoftBodies(PhysicsWorld* world) {
+    SoftBodySet* bodies = world->soft_bodies;
+    if (!bodies) return;
+    Particle* particles = world->particles;
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    // Area pass: C = area - restArea, gradient of the area at vertex k is
+    // 0.5 * (y[k+1] - y[k-1], x[k-1] - x[k+1])
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < bodies->num_soft_bodies; b++) {
+        int offset = bodies->soft_body_offset[b];
+        int count = bodies->soft_body_count[b];
+        mfloat_t area = 0.0f;
+        mfloat_t gradient_sq = 0.0f;
+        for (int k = 0; k < count; k++) {
+            mfloat_t prev[VEC2_SIZE];
+            mfloat_t curr[VEC2_SIZE];
+            mfloat_t next[VEC2_SIZE];
+            ringVertex(particles, offset, (k + count - 1) % count, wrap, prev);
+            ringVertex(particles, offset, k, wrap, curr);
+            ringVertex(particles, offset, (k + 1) % count, wrap, next);
+            area += curr[0] * next[1] - next[0] * curr[1];
+            mfloat_t gx = 0.5f * (next[1] - prev[1]);
+            mfloat_t gy = 0.5f * (prev[0] - next[0]);
+            gradient_sq += gx * gx + gy * gy;
+        }
+        area *= 0.5f;
+
+        // Bodies that have not fully spawned are left alone
+        mfloat_t active = (mfloat_t)(offset + count <= world->active_particles);
+        bodies->soft_body_lambda[b] = active * bodies->soft_body_stiffness[b]
+                                    * (bodies->soft_body_rest_area[b] - area) / (gradient_sq + MFLT_EPSILON);
+    }
+
+    // Apply pass: every body owns a disjoint particle range. The gradient at
+    // vertex k needs the unmodified position of vertex k - 1, so keep it in
+    // a rolling variable while walking the ring.
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < bodies->num_soft_bodies; b++) {
+        mfloat_t lambda = bodies->soft_body_lambda[b];
+        if (lambda == 0.0f) continue;
+
+        int offset = bodies->soft_body_offset[b];
+        int count = bodies->soft_body_count[b];
+        mfloat_t first[VEC2_SIZE];
+        mfloat_t prev[VEC2_SIZE];
+        vec2_assign(first, particles[offset].curr_position);
+        vec2_assign(prev, particles[offset + count - 1].curr_position);
+        for (int k = 0; k < count; k++) {
+            mfloat_t* curr = particles[offset + k].curr_position;
+            const mfloat_t* next = (k + 1 < count) ? particles[offset + k + 1].curr_position : first;
+            mfloat_t gx = 0.5f * wrapSeparation(next[1] - prev[1], wrap[1]);
+            mfloat_t gy = 0.5f * wrapSeparation(prev[0] - next[0], wrap[0]);
+            vec2_assign(prev, curr);
+            curr[0] += lambda * gx;
+            curr[1] += lambda * gy;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef SOFTBODY_H
+#define SOFTBODY_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define MAX_SOFT_BODIES 8192
+
+// A soft body is a closed ring of consecutive particles
+// [soft_body_offset[b], soft_body_offset[b] + soft_body_count[b]) held
+// together by edge links plus an area-preserving pressure constraint. In
+// the periodic box the ring is measured through the nearest images, so it
+// may straddle a wrapped side.
+typedef struct SoftBodySet {
+    int soft_body_offset[MAX_SOFT_BODIES];
+    int soft_body_count[MAX_SOFT_BODIES];
+    mfloat_t soft_body_rest_area[MAX_SOFT_BODIES];
+    mfloat_t soft_body_pressure[MAX_SOFT_BODIES];
+    mfloat_t soft_body_stiffness[MAX_SOFT_BODIES];
+    int num_soft_bodies;
+
+    // Per-body Lagrange multiplier produced by the area pass
+    mfloat_t soft_body_lambda[MAX_SOFT_BODIES];
+} SoftBodySet;
+
+// Registers particles [firstParticle, firstParticle + numParticles) as a
+// ring, linking neighbours with the given edge stiffness. The rest area is
+// the current area scaled by pressure (1 keeps the spawn shape).
+// Returns the body index, or -1 on failure, including when the range
+// shares a particle with an existing body.
+int addSoftBody(PhysicsWorld* world, int firstParticle, int numParticles, mfloat_t pressure, mfloat_t edgeStiffness);
+
+// Places numParticles particles on a circle around center, then calls
+// addSoftBody. Adjacent particles should be at least 2 * PARTICLE_RADIUS
+// apart, so radius should be >= numParticles * PARTICLE_RADIUS / PI.
+int createSoftBody(PhysicsWorld* world, mfloat_t* center, mfloat_t radius, int firstParticle, int numParticles,
+                   mfloat_t pressure, mfloat_t edgeStiffness);
+
+void clearSoftBodies(PhysicsWorld* world);
+
+// Applies the pressure constraint to every body whose particles are all
+// active. Areas and gradients are computed for all bodies in one batched
+// pass, then corrections are applied in a second pass.
+void solveSoftBodies(PhysicsWorld* world);
+
+#endif
@@ -0,0 +1,160 @@
+#include "sph.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// 2D kernels with unit particle mass
+static inline mfloat_t poly6(mfloat_t r_sq, mfloat_t h) {
+    mfloat_t diff = MFMAX(h * h - r_sq, 0.0f);
+    return 4.0f / (MPI * MPOW(h, 8.0f)) * diff * diff * diff;
+}
+
+// Allocates the world's fluid state on first use
+static SphState* worldSph(PhysicsWorld* world) {
+    if (!world->sph) {
+        world->sph = (SphState*)calloc(1, sizeof(SphState));
+        if (!world->sph) {
+            fprintf(stderr, "Failed to allocate memory for SPH state\n");
+        }
+    }
+    return world->sph;
+}
+
+// Rest density is the density of a hexagonal lattice slightly looser than
+// touching, so pressure acts before hard collisions do
+static mfloat_t latticeRestDensity(mfloat_t h) {
+    const mfloat_t spacing = SPH_REST_SPACING;
+    const int reach = (int)MCEIL(h / spacing) + 1;
+    mfloat_t density = 0.0f;
+    for (int row = -reach; row <= reach; row++) {
+        for (int col = -reach; col <= reach; col++) {
+            mfloat_t x = (col + 0.5f * (row & 1)) * spacing;
+            mfloat_t y = row * spacing * 0.8660254f;
+            density += poly6(x * x + y * y, h);
+        }
+    }
+    return density;
+}
+
+void initSph(PhysicsWorld* world) {
+    SphState* sph = worldSph(world);
+    if (!sph) return;
+    SphParams* params = &sph->sph_params;
+    params->smoothing_radius = SPH_SMOOTHING_RADIUS;
+    params->sound_speed = SPH_SOUND_SPEED;
+    params->gamma = SPH_GAMMA;
+    params->viscosity = SPH_VISCOSITY;
+    params->rest_density = latticeRestDensity(params->smoothing_radius);
+}
+
+void setParticleFluid(PhysicsWorld* world, int first, int count, bool fluid) {
+    SphState* sph = worldSph(world);
+    if (!sph) return;
+    for (int i = first; i < first + count && i < NUM_PARTICLES; i++) {
+        if (i < 0) continue;
+        sph->num_fluid_particles += (int)fluid - (int)sph->particle_fluid[i];
+        sph->particle_fluid[i] = (unsigned char)fluid;
+    }
+}
+
+void applySph(PhysicsWorld* world, float dt) {
+    SphState* sph = world->sph;
+    const int activeParticles = world->active_particles;
+    if (!sph || sph->num_fluid_particles == 0 || activeParticles == 0) return;
+    // Fluid marked without initSph starts from the defaults; tuned
+    // parameters only get the rest density their smoothing radius implies
+    if (sph->sph_params.smoothing_radius <= 0.0f) {
+        initSph(world);
+    } else if (sph->sph_params.rest_density <= 0.0f) {
+        sph->sph_params.rest_density = latticeRestDensity(sph->sph_params.smoothing_radius);
+    }
+
+    const SphParams sph_params = sph->sph_params;
+    const unsigned char* particle_fluid = sph->particle_fluid;
+    mfloat_t* sph_density = sph->sph_density;
+    mfloat_t* sph_pressure = sph->sph_pressure;
+    Particle* particles = world->particles;
+
+    const mfloat_t h = sph_params.smoothing_radius;
+    const mfloat_t h_sq = h * h;
+    const mfloat_t poly6_coeff = 4.0f / (MPI * MPOW(h, 8.0f));
+    const mfloat_t spiky_grad_coeff = -30.0f / (MPI * MPOW(h, 5.0f));
+    const mfloat_t visc_lap_coeff = 40.0f / (MPI * MPOW(h, 5.0f));
+    const mfloat_t rest_density = sph_params.rest_density;
+    const mfloat_t gamma = sph_params.gamma;
+    const mfloat_t eos_stiffness = rest_density * sph_params.sound_speed * sph_params.sound_speed / gamma;
+
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    if (buildNeighborLists(world, h) < 0) return;
+    const int* neighbor_offsets = world->neighbor_offsets;
+    const int* neighbor_indices = world->neighbor_indices;
+
+    // Density and pressure. Neighbours are gathered into small fixed-size
+    // batches so the kernel evaluation is a straight SIMD loop.
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < activeParticles; i++) {
+        if (!particle_fluid[i]) continue;
+        const mfloat_t* pos = particles[i].curr_position;
+        mfloat_t density = 0.0f;
+        for (int base = neighbor_offsets[i]; base < neighbor_offsets[i + 1]; base += SPH_BATCH) {
+            int batch = neighbor_offsets[i + 1] - base;
+            if (batch > SPH_BATCH) batch = SPH_BATCH;
+
+            mfloat_t r_sq[SPH_BATCH];
+            mfloat_t weight[SPH_BATCH];
+            for (int k = 0; k < SPH_BATCH; k++) {
+                int j = neighbor_indices[base + (k < batch ? k : 0)];
+                mfloat_t dx = wrapSeparation(particles[j].curr_position[0] - pos[0], wrap[0]);
+                mfloat_t dy = wrapSeparation(particles[j].curr_position[1] - pos[1], wrap[1]);
+                r_sq[k] = dx * dx + dy * dy;
+                weight[k] = (mfloat_t)(k < batch && particle_fluid[j]);
+            }
+
+            #pragma omp simd reduction(+ : density)
+            for (int k = 0; k < SPH_BATCH; k++) {
+                mfloat_t diff = MFMAX(h_sq - r_sq[k], 0.0f);
+                density += weight[k] * poly6_coeff * diff * diff * diff;
+            }
+        }
+        sph_density[i] = density;
+
+        // Tait equation of state, clamped so the fluid never pulls itself
+        // together into clumps
+        mfloat_t pressure = eos_stiffness * (MPOW(density / rest_density, gamma) - 1.0f);
+        sph_pressure[i] = MFMAX(pressure, 0.0f);
+    }
+
+    // Pressure and viscosity forces. Each particle gathers from its
+    // neighbours and writes only its own acceleration.
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < activeParticles; i++) {
+        if (!particle_fluid[i]) continue;
+        Particle* p = &particles[i];
+        mfloat_t vx = (p->curr_position[0] - p->old_position[0]) / dt;
+        mfloat_t vy = (p->curr_position[1] - p->old_position[1]) / dt;
+        mfloat_t pressure_term = sph_pressure[i] / (sph_density[i] * sph_density[i]);
+        mfloat_t viscosity_term = sph_params.viscosity / sph_density[i];
+        mfloat_t ax = 0.0f;
+        mfloat_t ay = 0.0f;
+        for (int n = neighbor_offsets[i]; n < neighbor_offsets[i + 1]; n++) {
+            int j = neighbor_indices[n];
+            if (j == i || !particle_fluid[j]) continue;
+            Particle* q = &particles[j];
+            mfloat_t dx = wrapSeparation(p->curr_position[0] - q->curr_position[0], wrap[0]);
+            mfloat_t dy = wrapSeparation(p->curr_position[1] - q->curr_position[1], wrap[1]);
+            mfloat_t r = MSQRT(dx * dx + dy * dy) + MFLT_EPSILON;
+            mfloat_t falloff = MFMAX(h - r, 0.0f);
+
+            mfloat_t shared = pressure_term + sph_pressure[j] / (sph_density[j] * sph_density[j]);
+            mfloat_t grad = spiky_grad_coeff * falloff * falloff / r;
+            ax -= shared * grad * dx;
+            ay -= shared * grad * dy;
+
+            mfloat_t lap = viscosity_term * visc_lap_coeff * falloff / sph_density[j];
+            ax += lap * ((q->curr_position[0] - q->old_position[0]) / dt - vx);
+            ay += lap * ((q->curr_position[1] - q->old_position[1]) / dt - vy);
+        }
+        p->acceleration[0] += ax;
+        p->acceleration[1] += ay;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SPH_H
+#define SPH_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define SPH_SMOOTHING_RADIUS (2 * GRID_CELL_SIZE)
+#define SPH_REST_SPACING (2.5f * PARTICLE_RADIUS)
+#define SPH_SOUND_SPEED 1500.0f
+#define SPH_GAMMA 7.0f // Tait exponent; 1 gives a linear (ideal gas) equation of state
+#define SPH_VISCOSITY 40.0f
+#define SPH_BATCH 8 // Neighbours gathered per vectorized batch
+
+typedef struct {
+    mfloat_t smoothing_radius;
+    mfloat_t rest_density; // From SPH_REST_SPACING and the smoothing radius when <= 0
+    mfloat_t sound_speed;
+    mfloat_t gamma;
+    mfloat_t viscosity;
+} SphParams;
+
+typedef struct SphState {
+    SphParams sph_params;
+    mfloat_t sph_density[NUM_PARTICLES];
+    mfloat_t sph_pressure[NUM_PARTICLES];
+    unsigned char particle_fluid[NUM_PARTICLES];
+    int num_fluid_particles;
+} SphState;
+
+// Resets the parameters to the defaults above and computes the rest density
+void initSph(PhysicsWorld* world);
+
+// Marks particles [first, first + count) as fluid (or granular again)
+void setParticleFluid(PhysicsWorld* world, int first, int count, bool fluid);
+
+// Runs the density, pressure and force passes over the grid neighbour lists
+// and adds the resulting accelerations to every active fluid particle. dt is
+// the substep length, used to recover velocities for viscosity.
+void applySph(PhysicsWorld* world, float dt);
+
+#endif
@@ -0,0 +1,337 @@
+#include "tiles.h"
+#include "tools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TILE_FILE_VERSION 2
+
+// Tile files hold a header and one record per particle. Acceleration is
+// cleared every substep, so position, displacement, radius, temperature
+// and the particle's traits are all a resting particle needs.
+typedef struct {
+    char magic[4];
+    int version;
+    int count;
+} TileHeader;
+
+typedef struct {
+    float x, y;
+    float dx, dy; // Displacement over the last substep
+    float radius;
+    float temperature;
+    ParticleTraits traits;
+} TileRecord;
+
+int enableTiledWorld(PhysicsWorld* world, const char* directory, mfloat_t idleSeconds) {
+    if (strlen(directory) + 32 > MAX_TILE_PATH) {
+        printf("Error: tile directory path is too long (max %d)\n", MAX_TILE_PATH - 32);
+        return -1;
+    }
+    if (!world->tiles) {
+        world->tiles = (TileMap*)calloc(1, sizeof(TileMap));
+        if (!world->tiles) {
+            fprintf(stderr, "Failed to allocate memory for tile map\n");
+            return -1;
+        }
+    }
+    strcpy(world->tiles->directory, directory);
+    world->tiles->idle_seconds = idleSeconds;
+    return 0;
+}
+
+static inline int clampTile(int tile, int count) {
+    return tile < 0 ? 0 : (tile >= count ? count - 1 : tile);
+}
+
+static inline int tileColumn(mfloat_t x) {
+    return clampTile((int)MFLOOR(x / TILE_SIZE), TILE_COLUMNS);
+}
+
+static inline int tileRow(mfloat_t y) {
+    return clampTile((int)MFLOOR(y / TILE_SIZE), TILE_ROWS);
+}
+
+// Returns -1 if the path does not fit, rather than opening a truncated one
+static int tilePath(const TileMap* tiles, int tx, int ty, char* path) {
+    int length = snprintf(path, MAX_TILE_PATH, "%s/tile_%d_%d.bin", tiles->directory, tx, ty);
+    if (length < 0 || length >= MAX_TILE_PATH) {
+        printf("Error: path of tile (%d, %d) is longer than %d characters\n", tx, ty, MAX_TILE_PATH - 1);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the particles in the tile to its file and removes them from the
+// world. Returns the number paged out, or -1 if the file could not be written.
+static int pageOutTile(PhysicsWorld* world, int tx, int ty) {
+    TileMap* tiles = world->tiles;
+    Particle* particles = world->particles;
+    int count = 0;
+    for (int i = 0; i < world->active_particles; i++) {
+        const mfloat_t* pos = particles[i].curr_position;
+        count += (tileColumn(pos[0]) == tx && tileRow(pos[1]) == ty);
+    }
+    if (count == 0) return 0;
+    char path[MAX_TILE_PATH];
+    if (tilePath(tiles, tx, ty, path) < 0) return -1;
+
+    TileRecord* records = (TileRecord*)malloc(count * sizeof(TileRecord));
+    if (!records) {
+        fprintf(stderr, "Failed to allocate memory for tile records\n");
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < world->active_particles; i++) {
+        const Particle* p = &particles[i];
+        if (tileColumn(p->curr_position[0]) != tx || tileRow(p->curr_position[1]) != ty) continue;
+        TileRecord* r = &records[n++];
+        r->x = p->curr_position[0];
+        r->y = p->curr_position[1];
+        r->dx = p->curr_position[0] - p->old_position[0];
+        r->dy = p->curr_position[1] - p->old_position[1];
+        r->radius = p->radius;
+        r->temperature = p->temperature;
+        getParticleTraits(world, i, &r->traits);
+    }
+
+    FILE* file = fopen(path, "wb");
+    TileHeader header = {{'V', 'T', 'I', 'L'}, TILE_FILE_VERSION, count};
+    int written = file && fwrite(&header, sizeof(header), 1, file) == 1
+                       && fwrite(records, sizeof(TileRecord), count, file) == (size_t)count;
+    if (file && fclose(file) != 0) written = 0;
+    free(records);
+    if (!written) {
+        printf("Error: could not write tile file %s\n", path);
+        remove(path);
+        return -1;
+    }
+
+    for (int i = 0; i < world->active_particles;) {
+        const mfloat_t* pos = particles[i].curr_position;
+        if (tileColumn(pos[0]) != tx || tileRow(pos[1]) != ty || removeParticle(world, i) < 0) i++;
+    }
+    tiles->paged[tx][ty] = true;
+    tiles->paged_particles[tx][ty] = count;
+    tiles->num_paged_tiles++;
+    return count;
+}
+
+// Appends the tile's particles to the world and deletes its file. Returns
+// the number read back, or -1 if the tile stays paged.
+static int pageInTile(PhysicsWorld* world, int tx, int ty) {
+    TileMap* tiles = world->tiles;
+    int count = tiles->paged_particles[tx][ty];
+    if (world->active_particles + count > NUM_PARTICLES) {
+        printf("Error: no room to load tile (%d, %d) with %d particles\n", tx, ty, count);
+        return -1;
+    }
+
+    char path[MAX_TILE_PATH];
+    if (tilePath(tiles, tx, ty, path) < 0) return -1;
+    FILE* file = fopen(path, "rb");
+    TileHeader header;
+    if (!file || fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "VTIL", 4) != 0
+        || header.version != TILE_FILE_VERSION || header.count != count) {
+        printf("Error: could not read tile file %s\n", path);
+        if (file) fclose(file);
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        TileRecord r;
+        if (fread(&r, sizeof(r), 1, file) != 1) {
+            // Drop what was appended so far; the tile stays paged
+            printf("Error: tile file %s is truncated\n", path);
+            fclose(file);
+            return -1;
+        }
+        setParticleTraits(world, world->active_particles + k, &r.traits);
+        Particle* p = &world->particles[world->active_particles + k];
+        vec2(p->curr_position, r.x, r.y);
+        vec2(p->old_position, r.x - r.dx, r.y - r.dy);
+        vec2_zero(p->acceleration);
+        p->radius = r.radius;
+        p->temperature = r.temperature;
+    }
+    fclose(file);
+    remove(path);
+
+    world->active_particles += count;
+    tiles->paged[tx][ty] = false;
+    tiles->paged_particles[tx][ty] = 0;
+    tiles->idle_time[tx][ty] = 0.0f;
+    tiles->num_paged_tiles--;
+    return count;
+}
+
+// Pages in every paged tile overlapping [min, max]. Returns 1 if any was.
+static int wakeTileRange(PhysicsWorld* world, mfloat_t minX, mfloat_t minY, mfloat_t maxX, mfloat_t maxY) {
+    int woke = 0;
+    for (int tx = tileColumn(minX); tx <= tileColumn(maxX); tx++) {
+        for (int ty = tileRow(minY); ty <= tileRow(maxY); ty++) {
+            if (world->tiles->paged[tx][ty] && pageInTile(world, tx, ty) > 0) woke = 1;
+        }
+    }
+    return woke;
+}
+
+int wakeTiles(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius) {
+    if (!world->tiles || world->tiles->num_paged_tiles == 0) return world->active_particles;
+    if (wakeTileRange(world, center[0] - radius, center[1] - radius, center[0] + radius, center[1] + radius)) {
+        populateGrid(world);
+    }
+    return world->active_particles;
+}
+
+// True if the particles in the group's tiles can all leave the world. None
+// of them may be held by a constraint, and neither may any particle that
+// removeParticle would move down to fill their slots: those are the
+// particles outside the group in the last slots, one per leaving particle.
+static bool groupRemovable(const PhysicsWorld* world, int group[][2], int size) {
+    bool in_group[TILE_COLUMNS][TILE_ROWS];
+    memset(in_group, 0, sizeof(in_group));
+    for (int k = 0; k < size; k++) {
+        in_group[group[k][0]][group[k][1]] = true;
+    }
+    const Particle* particles = world->particles;
+    const int active = world->active_particles;
+    int leaving = 0;
+    for (int i = 0; i < active; i++) {
+        if (!in_group[tileColumn(particles[i].curr_position[0])][tileRow(particles[i].curr_position[1])]) continue;
+        if (isParticleConstrained(world, i)) return false;
+        leaving++;
+    }
+    for (int i = active - leaving; i < active; i++) {
+        bool in = in_group[tileColumn(particles[i].curr_position[0])][tileRow(particles[i].curr_position[1])];
+        if (!in && isParticleConstrained(world, i)) return false;
+    }
+    return true;
+}
+
+// Pages out each group of touching occupied tiles once every tile in it
+// has been idle long enough and none of its particles is constrained. Paging a tile alone would pull the support
+// from under the particles resting on it in the next tile. Returns 1 if
+// any tile was paged.
+static int pageOutQuietGroups(PhysicsWorld* world, int count[TILE_COLUMNS][TILE_ROWS]) {
+    TileMap* tiles = world->tiles;
+    bool visited[TILE_COLUMNS][TILE_ROWS];
+    memset(visited, 0, sizeof(visited));
+    int group[TILE_COLUMNS * TILE_ROWS][2];
+    int changed = 0;
+    for (int sx = 0; sx < TILE_COLUMNS; sx++) {
+        for (int sy = 0; sy < TILE_ROWS; sy++) {
+            if (visited[sx][sy] || tiles->paged[sx][sy] || count[sx][sy] == 0) continue;
+
+            // Flood fill over loaded, occupied tiles, 8-connected
+            int size = 0;
+            int next = 0;
+            bool quiet = true;
+            visited[sx][sy] = true;
+            group[size][0] = sx;
+            group[size][1] = sy;
+            size++;
+            while (next < size) {
+                int tx = group[next][0];
+                int ty = group[next][1];
+                next++;
+                quiet = quiet && tiles->idle_time[tx][ty] >= tiles->idle_seconds;
+                for (int nx = clampTile(tx - 1, TILE_COLUMNS); nx <= clampTile(tx + 1, TILE_COLUMNS); nx++) {
+                    for (int ny = clampTile(ty - 1, TILE_ROWS); ny <= clampTile(ty + 1, TILE_ROWS); ny++) {
+                        if (visited[nx][ny] || tiles->paged[nx][ny] || count[nx][ny] == 0) continue;
+                        visited[nx][ny] = true;
+                        group[size][0] = nx;
+                        group[size][1] = ny;
+                        size++;
+                    }
+                }
+            }
+            if (!quiet || !groupRemovable(world, group, size)) continue;
+            for (int k = 0; k < size; k++) {
+                if (pageOutTile(world, group[k][0], group[k][1]) > 0) changed = 1;
+            }
+        }
+    }
+    return changed;
+}
+
+int updateTiles(PhysicsWorld* world, float frameDt) {
+    TileMap* tiles = world->tiles;
+    if (!tiles) return world->active_particles;
+
+    // Particles per tile, tiles where something moved, and tiles near fast particles
+    int count[TILE_COLUMNS][TILE_ROWS];
+    bool moved[TILE_COLUMNS][TILE_ROWS];
+    bool near_fast[TILE_COLUMNS][TILE_ROWS];
+    memset(count, 0, sizeof(count));
+    memset(moved, 0, sizeof(moved));
+    memset(near_fast, 0, sizeof(near_fast));
+    const mfloat_t rest_step = TILE_REST_SPEED * frameDt;
+    const mfloat_t wake_step = TILE_WAKE_SPEED * frameDt;
+    for (int i = 0; i < world->active_particles; i++) {
+        const mfloat_t* pos = world->particles[i].curr_position;
+        int tx = tileColumn(pos[0]);
+        int ty = tileRow(pos[1]);
+        count[tx][ty]++;
+        // New slots have no last position and count as moving
+        bool known = i < tiles->last_active && !tiles->refilled[i];
+        mfloat_t dx = known ? pos[0] - tiles->last_position[i][0] : wake_step;
+        mfloat_t dy = known ? pos[1] - tiles->last_position[i][1] : wake_step;
+        mfloat_t step_sq = dx * dx + dy * dy;
+        if (step_sq <= rest_step * rest_step) continue;
+        moved[tx][ty] = true;
+        if (step_sq <= wake_step * wake_step) continue;
+        int tx_lo = tileColumn(pos[0] - TILE_WAKE_MARGIN);
+        int tx_hi = tileColumn(pos[0] + TILE_WAKE_MARGIN);
+        int ty_lo = tileRow(pos[1] - TILE_WAKE_MARGIN);
+        int ty_hi = tileRow(pos[1] + TILE_WAKE_MARGIN);
+        for (int nx = tx_lo; nx <= tx_hi; nx++) {
+            for (int ny = ty_lo; ny <= ty_hi; ny++) {
+                near_fast[nx][ny] = true;
+            }
+        }
+    }
+
+    int changed = 0;
+    for (int tx = 0; tx < TILE_COLUMNS; tx++) {
+        for (int ty = 0; ty < TILE_ROWS; ty++) {
+            if (tiles->paged[tx][ty]) {
+                // Anything inside a paged tile would overlap its particles
+                if ((near_fast[tx][ty] || count[tx][ty] > 0) && pageInTile(world, tx, ty) > 0) changed = 1;
+            } else if (moved[tx][ty] || near_fast[tx][ty]) {
+                tiles->idle_time[tx][ty] = 0.0f;
+            } else {
+                tiles->idle_time[tx][ty] += frameDt;
+            }
+        }
+    }
+
+    // Paging out a grabbed particle would drop it from the drag
+    if (!world->tools || world->tools->num_dragged == 0) {
+        changed |= pageOutQuietGroups(world, count);
+    }
+
+    // Moved particles left their old indices behind in the grid
+    if (changed) populateGrid(world);
+    for (int i = 0; i < world->active_particles; i++) {
+        tiles->last_position[i][0] = world->particles[i].curr_position[0];
+        tiles->last_position[i][1] = world->particles[i].curr_position[1];
+        tiles->refilled[i] = false;
+    }
+    tiles->last_active = world->active_particles;
+    return world->active_particles;
+}
+
+void cleanupTiles(PhysicsWorld* world) {
+    TileMap* tiles = world->tiles;
+    if (!tiles) return;
+    for (int tx = 0; tx < TILE_COLUMNS; tx++) {
+        for (int ty = 0; ty < TILE_ROWS; ty++) {
+            if (!tiles->paged[tx][ty]) continue;
+            char path[MAX_TILE_PATH];
+            if (tilePath(tiles, tx, ty, path) == 0) remove(path);
+            tiles->paged[tx][ty] = false;
+            tiles->paged_particles[tx][ty] = 0;
+        }
+    }
+    tiles->num_paged_tiles = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define TILE_SIZE 128 // Side of a square tile
+#define TILE_COLUMNS (WINDOW_WIDTH / TILE_SIZE + 1)
+#define TILE_ROWS (WINDOW_HEIGHT / TILE_SIZE + 1)
+#define TILE_REST_SPEED 10.0f // Particles moving faster keep their tile awake
+#define TILE_WAKE_SPEED 100.0f // Particles moving faster also wake tiles nearby
+#define TILE_WAKE_MARGIN (2 * GRID_CELL_SIZE) // Reach of a fast particle
+#define MAX_TILE_PATH 256
+
+// Tiled world mode. The world is split into TILE_SIZE tiles. Activity is
+// the distance particles actually covered since the last update; the
+// Verlet velocity of particles resting against a wall stays well above
+// zero, so it cannot tell. A tile idle for idle_seconds, with quiet
+// neighbours, is written to its own file and its particles leave the
+// world. A paged tile is read back as soon as a particle enters it or a
+// fast particle or a tool comes within reach. Steps then only pay for the
+// particles still loaded.
+//
+// Groups holding particles of links, soft bodies or rigid clusters stay
+// loaded, since those refer to particles by slot.
+//
+// Paging does not make the world larger than the window. The tile map, the
+// collision grid and the NUM_PARTICLES arrays all cover the whole window,
+// and populateGrid clears every grid cell each substep. Memory and the
+// per-step grid cost therefore scale with the window, and only the
+// per-particle work shrinks with the loaded particles.
+typedef struct TileMap {
+    char directory[MAX_TILE_PATH];
+    mfloat_t idle_seconds;
+    mfloat_t idle_time[TILE_COLUMNS][TILE_ROWS]; // Seconds since the tile last saw motion
+    mfloat_t last_position[NUM_PARTICLES][VEC2_SIZE]; // Positions at the last update
+    int last_active; // Slots past this were filled since the last update
+    bool refilled[NUM_PARTICLES]; // Slots below it that were refilled since then
+    int paged_particles[TILE_COLUMNS][TILE_ROWS]; // Particles on disk, 0 if loaded
+    bool paged[TILE_COLUMNS][TILE_ROWS];
+    int num_paged_tiles;
+} TileMap;
+
+// Turns on tiled mode with tile files kept in directory, which must exist.
+// Returns -1 if the path is too long or memory runs out.
+int enableTiledWorld(PhysicsWorld* world, const char* directory, mfloat_t idleSeconds);
+
+// Pages tiles in and out frameDt seconds after the previous update.
+// Paging moves particles between slots with removeParticle, so it waits
+// while particles are dragged.
+// Returns the new active particle count.
+int updateTiles(PhysicsWorld* world, float frameDt);
+
+// Reads back every paged tile within radius of center, e.g. before a
+// query there. Returns the new active particle count.
+int wakeTiles(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius);
+
+// Deletes the tile files; paged particles are lost
+void cleanupTiles(PhysicsWorld* world);
+
+#endif
@@ -0,0 +1,159 @@
+#include "tools.h"
+#include "tiles.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PARALLEL_BATCH_THRESHOLD 1024
+
+// Allocates the world's tool state on first use
+static ToolState* worldTools(PhysicsWorld* world) {
+    if (!world->tools) {
+        world->tools = (ToolState*)calloc(1, sizeof(ToolState));
+        if (!world->tools) {
+            fprintf(stderr, "Failed to allocate memory for tool state\n");
+        }
+    }
+    return world->tools;
+}
+
+void applyExplosion(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius, mfloat_t speed, float subDt) {
+    ToolState* tools = worldTools(world);
+    if (!tools) return;
+    wakeTiles(world, center, radius);
+    const int* tool_indices = tools->tool_indices;
+    int count = queryRadius(world, center, radius, tools->tool_indices, NUM_PARTICLES);
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    #pragma omp parallel for if (count > PARALLEL_BATCH_THRESHOLD)
+    for (int k = 0; k < count; k++) {
+        Particle* p = &world->particles[tool_indices[k]];
+        mfloat_t dx = wrapSeparation(p->curr_position[0] - center[0], wrap[0]);
+        mfloat_t dy = wrapSeparation(p->curr_position[1] - center[1], wrap[1]);
+        mfloat_t dist = MSQRT(dx * dx + dy * dy);
+        // Velocity lives in the gap between the current and old position
+        mfloat_t kick = speed * (1.0f - dist / radius) * subDt / (dist + MFLT_EPSILON);
+        p->old_position[0] -= dx * kick;
+        p->old_position[1] -= dy * kick;
+    }
+}
+
+int beginDrag(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius) {
+    ToolState* tools = worldTools(world);
+    if (!tools) return 0;
+    wakeTiles(world, center, radius);
+    int num_dragged = queryRadius(world, center, radius, tools->drag_indices, MAX_DRAGGED_PARTICLES);
+    if (num_dragged > MAX_DRAGGED_PARTICLES) num_dragged = MAX_DRAGGED_PARTICLES;
+    for (int k = 0; k < num_dragged; k++) {
+        const mfloat_t* pos = world->particles[tools->drag_indices[k]].curr_position;
+        tools->drag_offsets[k][0] = wrapSeparation(pos[0] - center[0], periodicWrap(world, 0));
+        tools->drag_offsets[k][1] = wrapSeparation(pos[1] - center[1], periodicWrap(world, 1));
+    }
+    tools->drag_target[0] = center[0];
+    tools->drag_target[1] = center[1];
+    tools->num_dragged = num_dragged;
+    return num_dragged;
+}
+
+void moveDrag(PhysicsWorld* world, const mfloat_t* center) {
+    if (!world->tools) return;
+    world->tools->drag_target[0] = center[0];
+    world->tools->drag_target[1] = center[1];
+}
+
+void endDrag(PhysicsWorld* world) {
+    if (world->tools) world->tools->num_dragged = 0;
+}
+
+void applyDrag(PhysicsWorld* world) {
+    const ToolState* tools = world->tools;
+    if (!tools || tools->num_dragged == 0) return;
+    const int activeParticles = world->active_particles;
+    const int num_dragged = tools->num_dragged;
+    const mfloat_t* drag_target = tools->drag_target;
+    // A grabbed particle that crossed a wrapped side is pulled along the
+    // short way round
+    const mfloat_t wrap[VEC2_SIZE] = {periodicWrap(world, 0), periodicWrap(world, 1)};
+
+    #pragma omp parallel for if (num_dragged > PARALLEL_BATCH_THRESHOLD)
+    for (int k = 0; k < num_dragged; k++) {
+        if (tools->drag_indices[k] >= activeParticles) continue;
+        Particle* p = &world->particles[tools->drag_indices[k]];
+        p->curr_position[0] += wrapSeparation(drag_target[0] + tools->drag_offsets[k][0] - p->curr_position[0], wrap[0]) * DRAG_STIFFNESS;
+        p->curr_position[1] += wrapSeparation(drag_target[1] + tools->drag_offsets[k][1] - p->curr_position[1], wrap[1]) * DRAG_STIFFNESS;
+    }
+}
+
+void moveDraggedParticle(PhysicsWorld* world, int from, int to) {
+    ToolState* tools = world->tools;
+    if (!tools) return;
+    for (int k = 0; k < tools->num_dragged;) {
+        if (tools->drag_indices[k] == to) {
+            // Slot to lost its particle, even when from == to and nothing
+            // moves in. Fill the gap from the end of the list, like the
+            // particles themselves.
+            int end = --tools->num_dragged;
+            tools->drag_indices[k] = tools->drag_indices[end];
+            tools->drag_offsets[k][0] = tools->drag_offsets[end][0];
+            tools->drag_offsets[k][1] = tools->drag_offsets[end][1];
+            continue;
+        }
+        if (tools->drag_indices[k] == from) tools->drag_indices[k] = to;
+        k++;
+    }
+}
+
+int brushSpawn(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius) {
+    // Paged particles must be back before the occupancy test
+    int activeParticles = wakeTiles(world, center, radius);
+    // A world-aligned lattice lets repeated strokes fill gaps without
+    // stacking particles on top of each other
+    int i_lo = (int)MCEIL((center[0] - radius) / BRUSH_SPACING);
+    int i_hi = (int)MFLOOR((center[0] + radius) / BRUSH_SPACING);
+    int j_lo = (int)MCEIL((center[1] - radius) / BRUSH_SPACING);
+    int j_hi = (int)MFLOOR((center[1] + radius) / BRUSH_SPACING);
+    for (int i = i_lo; i <= i_hi && activeParticles < NUM_PARTICLES; i++) {
+        for (int j = j_lo; j <= j_hi && activeParticles < NUM_PARTICLES; j++) {
+            mfloat_t pos[VEC2_SIZE] = {i * BRUSH_SPACING, j * BRUSH_SPACING};
+            mfloat_t dx = pos[0] - center[0];
+            mfloat_t dy = pos[1] - center[1];
+            if (dx * dx + dy * dy > radius * radius) continue;
+            if (queryRadius(world, pos, 2.0f * PARTICLE_RADIUS, NULL, 0) > 0) continue;
+
+            initParticleSlot(world, activeParticles);
+            Particle* p = &world->particles[activeParticles++];
+            world->active_particles = activeParticles;
+            vec2_assign(p->curr_position, pos);
+            vec2_assign(p->old_position, pos);
+            vec2_zero(p->acceleration);
+            p->radius = PARTICLE_RADIUS;
+            p->temperature = AMBIENT_TEMPERATURE;
+            insertIntoGrid(world, activeParticles - 1); // Later lattice points and strokes see it
+        }
+    }
+    return activeParticles;
+}
+
+static int compareDescending(const void* a, const void* b) {
+    return *(const int*)b - *(const int*)a;
+}
+
+int brushErase(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius) {
+    ToolState* tools = worldTools(world);
+    if (!tools) return world->active_particles;
+    int* tool_indices = tools->tool_indices;
+    wakeTiles(world, center, radius);
+    int count = queryRadius(world, center, radius, tool_indices, NUM_PARTICLES);
+
+    // Highest indices first, so a slot is never refilled from a particle
+    // that is itself being erased. Constrained particles stay, and so does
+    // any particle whose removal would move a constrained one.
+    qsort(tool_indices, count, sizeof(int), compareDescending);
+    int removed = 0;
+    for (int k = 0; k < count; k++) {
+        removed += removeParticle(world, tool_indices[k]) == 0;
+    }
+
+    // Moved particles left their old indices behind in the grid
+    if (removed > 0) populateGrid(world);
+    return world->active_particles;
+}
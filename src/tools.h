@@ -0,0 +1,51 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
+#include "mathc.h"
+#include "physics.h"
+
+#define TOOL_RADIUS 60.0f
+#define EXPLODE_SPEED 900.0f // Speed given to particles at the center of an explosion
+#define DRAG_STIFFNESS 0.05f // Share of the gap to the cursor closed per substep
+#define MAX_DRAGGED_PARTICLES 4096
+#define BRUSH_SPACING (2.2f * PARTICLE_RADIUS)
+
+typedef struct ToolState {
+    // Particles under the current tool, filled by a single grid query
+    int tool_indices[NUM_PARTICLES];
+
+    int drag_indices[MAX_DRAGGED_PARTICLES];
+    mfloat_t drag_offsets[MAX_DRAGGED_PARTICLES][VEC2_SIZE];
+    mfloat_t drag_target[VEC2_SIZE];
+    int num_dragged;
+} ToolState;
+
+// Interactive tools. Each gathers the particles under the tool with one
+// grid query and then processes that batch, so the cost follows the area
+// covered rather than the particle count. Call them between steps. Paged
+// tiles under a tool are loaded first.
+
+// Gives particles within radius an outward velocity falling off linearly
+// from speed at the center. subDt is the current substep length.
+void applyExplosion(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius, mfloat_t speed, float subDt);
+
+// Grabs the particles within radius of center and keeps their offsets to
+// it. Returns the number grabbed.
+int beginDrag(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius);
+void moveDrag(PhysicsWorld* world, const mfloat_t* center);
+void endDrag(PhysicsWorld* world);
+// Pulls grabbed particles towards their targets; call once per substep
+void applyDrag(PhysicsWorld* world);
+// Releases grabbed particle to, then renames grabbed particle from to to.
+// Called when a particle moves between slots; from == to only releases it.
+void moveDraggedParticle(PhysicsWorld* world, int from, int to);
+
+// Activates inactive particles on a world-aligned lattice inside the
+// brush, skipping lattice points that are already occupied. Returns the
+// new active particle count.
+int brushSpawn(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius);
+// Removes the particles inside the brush with removeParticle, which skips
+// particles held by constraints. Returns the new active particle count.
+int brushErase(PhysicsWorld* world, const mfloat_t* center, mfloat_t radius);
+
+#endif
@@ -0,0 +1,142 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L // shm_open, ftruncate, process-shared barriers
+#endif
+
+#include "transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+DomainTransport* createShmTransport(int numRanks) {
+    (void)numRanks;
+    printf("Error: the shared memory transport needs POSIX shared memory\n");
+    return NULL;
+}
+
+#else
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef struct {
+    int count;
+    Particle particles[DOMAIN_MAILBOX_CAPACITY];
+} Mailbox;
+
+// Start of the shared segment; the mailboxes follow it
+typedef struct {
+    pthread_barrier_t barrier;
+    int num_ranks;
+} ShmHeader;
+
+typedef struct {
+    ShmHeader* header;
+    Mailbox* mailboxes;
+    size_t size;
+} ShmState;
+
+static Mailbox* mailbox(const DomainTransport* self, int from, int to, int channel) {
+    const ShmState* shm = (const ShmState*)self->state;
+    return &shm->mailboxes[(from * self->num_ranks + to) * NUM_CHANNELS + channel];
+}
+
+static int shmPost(DomainTransport* self, int to, int channel, const Particle* particles, int count) {
+    if (to < 0 || to >= self->num_ranks || count > DOMAIN_MAILBOX_CAPACITY) return -1;
+    Mailbox* box = mailbox(self, self->rank, to, channel);
+    memcpy(box->particles, particles, count * sizeof(Particle));
+    box->count = count;
+    return 0;
+}
+
+// Mailboxes are written in place, so a sender may only overwrite a channel
+// after every receiver has collected from it. Alternating channels gives
+// that for free: a rank reaches the next exchange on the other channel only
+// after it has finished collecting.
+static void shmExchange(DomainTransport* self, int channel) {
+    (void)channel;
+    pthread_barrier_wait(&((ShmState*)self->state)->header->barrier);
+}
+
+static int shmCollect(DomainTransport* self, int from, int channel, Particle* out, int maxCount) {
+    if (from < 0 || from >= self->num_ranks) return 0;
+    Mailbox* box = mailbox(self, from, self->rank, channel);
+    int count = box->count < maxCount ? box->count : maxCount;
+    memcpy(out, box->particles, count * sizeof(Particle));
+    box->count = 0;
+    return count;
+}
+
+static void shmBarrier(DomainTransport* self) {
+    pthread_barrier_wait(&((ShmState*)self->state)->header->barrier);
+}
+
+static void shmDestroy(DomainTransport* self) {
+    ShmState* shm = (ShmState*)self->state;
+    // The last process to unmap releases the segment
+    munmap(shm->header, shm->size);
+    free(shm);
+    free(self);
+}
+
+DomainTransport* createShmTransport(int numRanks) {
+    if (numRanks < 1) return NULL;
+    DomainTransport* transport = (DomainTransport*)calloc(1, sizeof(DomainTransport));
+    ShmState* shm = (ShmState*)calloc(1, sizeof(ShmState));
+    if (!transport || !shm) {
+        fprintf(stderr, "Failed to allocate memory for the shared memory transport\n");
+        free(transport);
+        free(shm);
+        return NULL;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/verlet-domain-%ld", (long)getpid());
+    size_t mailboxes = (size_t)numRanks * numRanks * NUM_CHANNELS;
+    size_t header_size = (sizeof(ShmHeader) + 63) / 64 * 64;
+    shm->size = header_size + mailboxes * sizeof(Mailbox);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        printf("Error: could not create shared memory segment %s\n", name);
+        free(transport);
+        free(shm);
+        return NULL;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)shm->size) == 0) {
+        base = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    shm_unlink(name);
+    if (base == MAP_FAILED) {
+        printf("Error: could not map %zu bytes of shared memory\n", shm->size);
+        free(transport);
+        free(shm);
+        return NULL;
+    }
+
+    shm->header = (ShmHeader*)base;
+    shm->mailboxes = (Mailbox*)((char*)base + header_size);
+    shm->header->num_ranks = numRanks;
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&shm->header->barrier, &attr, (unsigned)numRanks);
+    pthread_barrierattr_destroy(&attr);
+
+    transport->rank = 0;
+    transport->num_ranks = numRanks;
+    transport->post = shmPost;
+    transport->exchange = shmExchange;
+    transport->collect = shmCollect;
+    transport->barrier = shmBarrier;
+    transport->destroy = shmDestroy;
+    transport->state = shm;
+    return transport;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "physics.h"
+
+#define DOMAIN_MAILBOX_CAPACITY 2048 // Particles per message
+
+// Message channels. Each channel has its own mailboxes, so a message on
+// one channel can be read while the next one on the other is being written.
+#define CHANNEL_HALO 0
+#define CHANNEL_MIGRATE 1
+#define NUM_CHANNELS 2
+
+// Moves particles between the processes of a domain decomposition. A
+// round on a channel is: every rank posts to any ranks it wants, every
+// rank calls exchange, then every rank collects. Backends implement the
+// function pointers; only the shared-memory one exists so far, and a
+// socket or MPI backend slots in behind the same calls.
+typedef struct DomainTransport {
+    int rank;
+    int num_ranks;
+
+    // Queues count particles for rank to. Returns -1 if they do not fit.
+    int (*post)(struct DomainTransport* self, int to, int channel, const Particle* particles, int count);
+    // Collective: returns once every rank has posted its round on channel
+    void (*exchange)(struct DomainTransport* self, int channel);
+    // Copies up to maxCount particles that rank from posted to this rank
+    // during the last round on channel. Returns the number copied.
+    int (*collect)(struct DomainTransport* self, int from, int channel, Particle* out, int maxCount);
+    // Collective: returns once every rank has called it
+    void (*barrier)(struct DomainTransport* self);
+    void (*destroy)(struct DomainTransport* self);
+
+    void* state; // Backend data
+} DomainTransport;
+
+// Creates a transport over a POSIX shared memory segment with one mailbox
+// per (sender, receiver, channel). The segment is unlinked right away, so
+// only processes forked from the caller afterwards can reach it; each must
+// set rank before the first round. Returns NULL on failure or on platforms
+// without POSIX shared memory.
+DomainTransport* createShmTransport(int numRanks);
+
+#endif